@@ -64,6 +64,9 @@ def read_file(param):
     for i in range(0,len(file_mass)):
         lm=file_mass[i].strip()
         ld=file_delta[i].strip()
+        # QDP comment (e.g., the seed of the Monte Carlo replicas)
+        if lm[0]=='!':
+            continue
         if lm[0]=='n':
             flag=True
             old_m=0
@@ -89,6 +92,8 @@ def read_file(param):
             flag1=True
             while True:
                 lgm=file_gm.readline().strip()
+                if lgm[0]=='!':
+                    continue
                 if lgm[0]=='n':
                     break
                 rgm,gm=lgm.split()
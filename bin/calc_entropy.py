@@ -35,11 +35,13 @@ def get_entropy(data, r):
 
 def read_merged_qdp(infile):
     """
-    Read merged QDP with multiple group of data separated by "no no no".
+    Read merged QDP with multiple group of data separated by "no no no",
+    skipping the comment lines (starting with "!").
     """
     lines = map(lambda line: re.sub(r"^\s*no\s+no\s+no.*$", "X",
                                     line.strip(), flags=re.I),
-                open(infile).readlines())
+                filter(lambda line: not line.lstrip().startswith("!"),
+                       open(infile).readlines()))
     lines = isplit(lines, ("X",))
     data_groups = []
     for block in lines:
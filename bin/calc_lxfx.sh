@@ -17,6 +17,10 @@
 # Weitian LI
 # 2016-06-07
 #
+# The Monte Carlo replicas are run by 'calc_lx_*' itself (option '-mc'),
+# with the cooling function tables of the bands
+# ('coolfunc_table_erg_*.txt', made once by 'calc_coolfunc_table.py').
+#
 
 if [ $# -eq 2 ] || [ $# -eq 3 ]; then
     :
@@ -85,64 +89,12 @@ ${base_path}/calc_coolfunc_bands.sh ${tprofile} ${abund} \
             0 ${z} "cfunc_" ${BLIST}
 
 PROG="calc_lx_${MODEL}"
-LXF_RES="lx_${MODEL}_param.txt"
-${base_path}/${PROG} ${sbp_cfg} ${rout} \
-            cfunc_bolo.dat \
-            cfunc_0.7-7.dat \
-            cfunc_0.1-2.4.dat 2> /dev/null
-LX1=`grep '^Lx1' ${LX_RES} | awk '{ print $2 }'`
-LX2=`grep '^Lx2' ${LX_RES} | awk '{ print $2 }'`
-LX3=`grep '^Lx3' ${LX_RES} | awk '{ print $2 }'`
-FX1=`grep '^Fx1' ${LX_RES} | awk '{ print $2 }'`
-FX2=`grep '^Fx2' ${LX_RES} | awk '{ print $2 }'`
-FX3=`grep '^Fx3' ${LX_RES} | awk '{ print $2 }'`
-
-echo "${LX1} ${LX2} ${LX3}" >summary_lx.dat
-echo "${FX1} ${FX2} ${FX3}" >summary_fx.dat
-
-# save the calculated central values
-mv ${LX_RES} ${LX_RES%.txt}_center.txt
-mv lx_sbp_fit.qdp lx_sbp_fit_center.qdp
-mv lx_rho_fit.dat lx_rho_fit_center.dat
+LX_RES="lx_${MODEL}_param.txt"
 
 # only calculate the central values
 if [ "${F_C}" = "YES" ]; then
     echo "Calculate the central values only ..."
-    ${base_path}/analyze_lxfx.py "Lx" summary_lx.dat lx_result.txt ${BLIST}
-    ${base_path}/analyze_lxfx.py "Fx" summary_fx.dat fx_result.txt ${BLIST}
-    exit 0
-fi
-
-
-###########################################################
-# Estimate the errors of Lx and Fx by Monte Carlo simulation
-MC_TIMES=100
-for i in `seq 1 ${MC_TIMES}`; do
-    ${base_path}/shuffle_profile.py ${tprofile_data} tmp_tprofile.txt
-    ${base_path}/shuffle_profile.py ${sbp_data} tmp_sbprofile.txt
-
-    # temperature profile
-    ${base_path}/${PROG_TPROFILE} tmp_tprofile.txt ${tprofile_cfg} \
-                ${cm_per_pixel} 2> /dev/null
-    mv -f ${tprofile_dump} ${tprofile}
-
-    TMP_SBP_CFG="tmp_sbp.cfg"
-    [ -e "${TMP_SBP_CFG}" ] && rm -f ${TMP_SBP_CFG}
-    cat ${sbp_cfg} | while read l; do
-        if echo "${l}" | grep -q '^sbp_data' >/dev/null; then
-            echo "sbp_data  tmp_sbprofile.txt" >> ${TMP_SBP_CFG}
-        elif echo "${l}" | grep -q '^tprofile' >/dev/null; then
-            echo "tprofile  ${tprofile}" >> ${TMP_SBP_CFG}
-        else
-            echo "${l}" >> ${TMP_SBP_CFG}
-        fi
-    done
-
-    echo "### `pwd -P`"
-    echo "### ${i} / ${MC_TIMES} ###"
-    ${base_path}/calc_coolfunc_bands.sh ${tprofile} ${abund} \
-                0 ${z} "cfunc_" ${BLIST}
-    ${base_path}/${PROG} ${TMP_SBP_CFG} ${rout} \
+    ${base_path}/${PROG} ${sbp_cfg} ${rout} \
                 cfunc_bolo.dat \
                 cfunc_0.7-7.dat \
                 cfunc_0.1-2.4.dat 2> /dev/null
@@ -153,9 +105,60 @@ for i in `seq 1 ${MC_TIMES}`; do
     FX2=`grep '^Fx2' ${LX_RES} | awk '{ print $2 }'`
     FX3=`grep '^Fx3' ${LX_RES} | awk '{ print $2 }'`
 
-    echo "${LX1} ${LX2} ${LX3}" >>summary_lx.dat
-    echo "${FX1} ${FX2} ${FX3}" >>summary_fx.dat
-done # end of 'for'
+    echo "${LX1} ${LX2} ${LX3}" >summary_lx.dat
+    echo "${FX1} ${FX2} ${FX3}" >summary_fx.dat
+
+    # save the calculated central values
+    mv ${LX_RES} ${LX_RES%.txt}_center.txt
+    mv lx_sbp_fit.qdp lx_sbp_fit_center.qdp
+    mv lx_rho_fit.dat lx_rho_fit_center.dat
+
+    ${base_path}/analyze_lxfx.py "Lx" summary_lx.dat lx_result.txt ${BLIST}
+    ${base_path}/analyze_lxfx.py "Fx" summary_fx.dat fx_result.txt ${BLIST}
+    exit 0
+fi
+
+
+###########################################################
+# Estimate the errors of Lx and Fx by Monte Carlo simulation, with the
+# replicas run by the program itself, which interpolates the cooling
+# function tables of the bands on the temperature profile of each
+# replica, and writes the central values and then the replicas into
+# summary_lx.dat and summary_fx.dat;
+# MC_TIMES, MC_THREADS (0 for the OpenMP default) and MC_SEED can be set
+# in the environment; the seed is recorded in the summary files
+CFUNC_TABLES=""
+for band in bolo "0.7 7" "0.1 2.4"; do
+    if [ "${band}" = "bolo" ]; then
+        elow=0.01
+        ehigh=100.0
+        name_suffix="bolo"
+    else
+        elow=`echo ${band} | awk '{ print $1 }'`
+        ehigh=`echo ${band} | awk '{ print $2 }'`
+        name_suffix="${elow}-${ehigh}"
+    fi
+    cfunc_table="coolfunc_table_erg_${name_suffix}.txt"
+    if [ ! -f ${cfunc_table} ]; then
+        ${base_path}/calc_coolfunc_table.py -Z ${abund} -n 0 -z ${z} \
+                    -L ${elow} -H ${ehigh} -u erg -o ${cfunc_table}
+    fi
+    CFUNC_TABLES="${CFUNC_TABLES} ${cfunc_table}"
+done
+
+MC_TIMES=${MC_TIMES:-100}
+MC_THREADS=${MC_THREADS:-0}
+MC_SEED=${MC_SEED:-1}
+${base_path}/${PROG} ${sbp_cfg} ${rout} \
+            cfunc_bolo.dat \
+            cfunc_0.7-7.dat \
+            cfunc_0.1-2.4.dat \
+            -mc ${mass_cfg} ${MC_TIMES} ${MC_THREADS} ${MC_SEED} ${CFUNC_TABLES}
+
+# save the calculated central values
+mv ${LX_RES} ${LX_RES%.txt}_center.txt
+mv lx_sbp_fit.qdp lx_sbp_fit_center.qdp
+mv lx_rho_fit.dat lx_rho_fit_center.dat
 
 # analyze Lx & Fx Monte Carlo results
 ${base_path}/analyze_lxfx.py "Lx" summary_lx.dat lx_result.txt ${BLIST}
@@ -21,6 +21,8 @@
 #   * summary_overdensity.qdp
 #   * summary_gas_mass_profile.qdp
 #   * summary_entropy.qdp
+#   * summary_*_stat.qdp
+#   * summary_delta.txt
 #
 # Junhua Gu
 # Weitian LI
@@ -140,59 +142,16 @@ fi
 
 ## ------------------------------------------------------------------
 
-# clean previous files
-rm -f summary_overdensity.qdp
-rm -f summary_mass_profile.qdp
-rm -f summary_gas_mass_profile.qdp
-rm -f summary_entropy.qdp
-
-# Estimate the errors of Lx and Fx by Monte Carlo simulation
+# Estimate the errors of the mass profile by Monte Carlo simulation,
+# with the replicas run in one process (see src/fit_mass_mc.cpp);
+# MC_TIMES, MC_THREADS (0 for the OpenMP default) and MC_SEED can be set
+# in the environment; the seed is recorded in the summary files, and a
+# single replica is drawn again by, e.g., MC_TIMES=42-42
 printf "\n+++++++++++++++++++ Monte Carlo +++++++++++++++++++++\n"
-MC_TIMES=100
-for i in `seq 1 ${MC_TIMES}`; do
-    printf "\n## ${i} / ${MC_TIMES} ##\n"
-    printf "## `pwd` ##\n"
-
-    printf "Shuffling temperature profile & SBP ...\n"
-    ${base_path}/shuffle_profile.py ${tprofile_data} tmp_tprofile.txt
-    ${base_path}/shuffle_profile.py ${sbp_data} tmp_sbprofile.txt
-
-    printf "Fitting temperature profile ...\n"
-    ${base_path}/${PROG_TPROFILE} tmp_tprofile.txt ${tprofile_cfg} \
-                ${cm_per_pixel} 2> /dev/null
-    mv -f ${tprofile_dump} ${tprofile}
-
-    TMP_SBP_CFG="tmp_sbp.cfg"
-    [ -e "${TMP_SBP_CFG}" ] && rm -f ${TMP_SBP_CFG}
-    cat ${sbp_cfg} | while read l; do
-        if echo "${l}" | grep -q '^sbp_data' >/dev/null; then
-            echo "sbp_data  tmp_sbprofile.txt" >> ${TMP_SBP_CFG}
-        elif echo "${l}" | grep -q '^tprofile' >/dev/null; then
-            echo "tprofile  ${tprofile}" >> ${TMP_SBP_CFG}
-        else
-            echo "${l}" >> ${TMP_SBP_CFG}
-        fi
-    done
-
-    ${base_path}/calc_coolfunc_profile.py -C -t ${cfunc_table} \
-                -T ${tprofile} -o ${cfunc_profile}
-    printf "Fitting SBP profile ...\n"
-    ${base_path}/${PROG_SBPFIT} ${TMP_SBP_CFG} 2> /dev/null
-    cat ${RES_SBPFIT}
-    ${base_path}/fit_nfw_mass mass_int.dat ${z} ${nfw_rmin_kpc} 2> /dev/null
-    cat nfw_dump.qdp     >> summary_mass_profile.qdp
-    echo "no no no"      >> summary_mass_profile.qdp
-    cat overdensity.qdp  >> summary_overdensity.qdp
-    echo "no no no"      >> summary_overdensity.qdp
-    cat gas_mass_int.qdp >> summary_gas_mass_profile.qdp
-    echo "no no no"      >> summary_gas_mass_profile.qdp
-    cat entropy.qdp      >> summary_entropy.qdp
-    echo "no no no"      >> summary_entropy.qdp
-done  # end of `for'
-
-# recover the files of original center values
-cp -f ${cfunc_profile_center} ${cfunc_profile}
-cp -f ${tprofile_center} ${tprofile}
+MC_TIMES=${MC_TIMES:-100}
+MC_THREADS=${MC_THREADS:-0}
+MC_SEED=${MC_SEED:-1}
+${base_path}/fit_mass_mc ${mass_cfg} ${cfunc_table} ${MC_TIMES} ${MC_THREADS} ${MC_SEED}
 printf "\n+++++++++++++++++ MONTE CARLO END +++++++++++++++++++\n\n"
 
 ## analyze results
@@ -201,10 +160,9 @@ RES_FINAL="final_result.txt"
 [ -e "${RES_TMP}" ]   && mv -fv ${RES_TMP}   ${RES_TMP}_bak
 [ -e "${RES_FINAL}" ] && mv -fv ${RES_FINAL} ${RES_FINAL}_bak
 
-${base_path}/analyze_mass_profile.py  200 | tee -a ${RES_TMP}
-${base_path}/analyze_mass_profile.py  500 | tee -a ${RES_TMP}
-${base_path}/analyze_mass_profile.py 1500 | tee -a ${RES_TMP}
-${base_path}/analyze_mass_profile.py 2500 | tee -a ${RES_TMP}
+# summarized by fit_mass_mc as the replicas are done, as by
+# analyze_mass_profile.py (the same order statistics of the same values)
+cat summary_delta.txt | tee -a ${RES_TMP}
 
 R200_VAL=`grep  '^r200'  ${RES_TMP} | awk '{ print $2 }'`
 R500_VAL=`grep  '^r500'  ${RES_TMP} | awk '{ print $2 }'`
@@ -0,0 +1,292 @@
+#ifndef ABEL_TREE_HPP
+#define ABEL_TREE_HPP
+/*
+  Fast projection engine for fine radial grids
+
+  The projection of a shell-wise constant emissivity e_j onto the
+  annulus i, i.e., sum_j e_j * V(i,j), is rewritten (summation by parts)
+  as
+      S_i = G(i) - G(i+1),
+      G(a) = 4pi/3 * sum_{b>a} (s_b - s_a)^{3/2} * d_b,
+  where s_b = r_b^2 and d_b = e_{b-1} - e_b is the emissivity jump at
+  the radius r_b (e_{-1} = e_n = 0).
+
+  G is evaluated with a binary tree over the knots: a group of knots that
+  is well separated from the target radius is replaced by the Taylor
+  expansion of the kernel about the group center (or, for a group lying
+  far outside the target, in powers of s_a/s_b), while the nearby knots
+  are summed directly.  The expansion order is chosen from the requested
+  tolerance, which bounds the relative truncation error of every group
+  contribution to G.  Since S_i is a difference of G values, the
+  tolerance is tightened by the number of bins.
+
+  The cost is O(N log N) per evaluation, with O(N) storage.
+*/
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include "parallel.hpp"
+
+template <typename T>
+class abel_tree
+{
+private:
+  struct node
+  {
+    //knot index range [lo, hi), knots are 1..n
+    size_t lo,hi;
+    //children, zero if this is a leaf
+    size_t left,right;
+    //center and half width in s=r^2
+    T center,width;
+  };
+
+  T theta;
+  T tol;
+  size_t leaf_size;
+  size_t order;
+  std::vector<T> rlist;
+  std::vector<T> slist;
+  std::vector<node> nodes;
+  std::vector<T> coeff;
+  //work spaces
+  std::vector<T> jump;
+  std::vector<T> moments;
+  std::vector<T> rmoments;
+  std::vector<T> glist;
+
+public:
+  abel_tree()
+    :theta(0.5),tol(1e-8),leaf_size(16),order(0)
+  {}
+
+  //relative error bound of the projected profile
+  void set_tolerance(T t)
+  {
+    tol=t;
+    rlist.clear();
+  }
+
+  T get_tolerance()const
+  {
+    return tol;
+  }
+
+  size_t get_order()const
+  {
+    return order;
+  }
+
+private:
+  size_t build(size_t lo,size_t hi)
+  {
+    node nd;
+    nd.lo=lo;
+    nd.hi=hi;
+    nd.left=nd.right=0;
+    nd.center=(slist[lo]+slist[hi-1])/2;
+    nd.width=(slist[hi-1]-slist[lo])/2;
+    size_t self=nodes.size();
+    nodes.push_back(nd);
+    if(hi-lo>leaf_size)
+      {
+        size_t mid=(lo+hi)/2;
+        size_t l=build(lo,mid);
+        size_t r=build(mid,hi);
+        nodes[self].left=l;
+        nodes[self].right=r;
+      }
+    return self;
+  }
+
+  void update_grid(const std::vector<T>& x)
+  {
+    using std::pow;
+    if(!rlist.empty() && rlist==x)
+      {
+        return;
+      }
+    rlist=x;
+    const size_t n=x.size()-1;
+    slist.resize(n+1);
+    for(size_t i=0;i<=n;++i)
+      {
+        slist[i]=x[i]*x[i];
+      }
+    nodes.clear();
+    build(1,n+1);
+
+    //truncation error of a group is below theta^(order+1)/(1-theta)
+    //relative to its contribution; S_i=G(i)-G(i+1) loses ~log10(n) digits
+    T tol_g=tol/n;
+    order=1;
+    while(pow(theta,T(order+1))/(1-theta)>tol_g && order<60)
+      {
+        ++order;
+      }
+    //binomial coefficients of (1+q)^(3/2)
+    coeff.resize(order+1);
+    coeff[0]=1;
+    for(size_t k=0;k<order;++k)
+      {
+        coeff[k+1]=coeff[k]*(1.5-k)/(k+1);
+      }
+  }
+
+public:
+  //x: n+1 radii; emis: n*nband shell emissivities stored as [nsph][band]
+  //result: n*nband projected values (the sum of emissivity times volume,
+  //in units of x^3) stored as [nrad][band]
+  void project(const std::vector<T>& x,const std::vector<T>& emis,
+               size_t nband,std::vector<T>& result)
+  {
+    using std::sqrt;
+    using std::atan;
+    update_grid(x);
+    const size_t n=x.size()-1;
+    const size_t nk=order+1;
+
+    //emissivity jumps at the knots 1..n
+    jump.assign((n+1)*nband,0);
+    for(size_t b=1;b<=n;++b)
+      {
+        for(size_t k=0;k<nband;++k)
+          {
+            T inner=emis[(b-1)*nband+k];
+            T outer=b<n?emis[b*nband+k]:T(0);
+            jump[b*nband+k]=inner-outer;
+          }
+      }
+
+    //scaled moments of each node about its center,
+    //  sum_b d_b ((s_b-center)/width)^j,
+    //and about the origin,
+    //  sum_b d_b s_b^(3/2) (s_min/s_b)^j
+    moments.assign(nodes.size()*nk*nband,0);
+    rmoments.assign(nodes.size()*nk*nband,0);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) if(n>=omp_min_bins())
+#endif
+    for(int m=0;m<(int)nodes.size();++m)
+      {
+        const node& nd=nodes[m];
+        T* mom=&moments[m*nk*nband];
+        T* rmom=&rmoments[m*nk*nband];
+        const T smin=slist[nd.lo];
+        for(size_t b=nd.lo;b<nd.hi;++b)
+          {
+            const T q=nd.width>0?(slist[b]-nd.center)/nd.width:T(0);
+            const T u=smin/slist[b];
+            const T* d=&jump[b*nband];
+            T pw=1;
+            T rpw=slist[b]*sqrt(slist[b]);
+            for(size_t j=0;j<nk;++j)
+              {
+                for(size_t k=0;k<nband;++k)
+                  {
+                    mom[j*nband+k]+=d[k]*pw;
+                    rmom[j*nband+k]+=d[k]*rpw;
+                  }
+                pw*=q;
+                rpw*=u;
+              }
+          }
+      }
+
+    //G(a) for the targets a=0..n
+    glist.assign((n+1)*nband,0);
+#ifdef _OPENMP
+#pragma omp parallel if(n>=omp_min_bins())
+#endif
+    {
+      std::vector<size_t> stack;
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic,32)
+#endif
+      for(int ia=0;ia<(int)n;++ia)
+        {
+          const size_t a=ia;
+          const T sa=slist[a];
+          T* g=&glist[a*nband];
+          stack.clear();
+          stack.push_back(0);
+          while(!stack.empty())
+            {
+              const node& nd=nodes[stack.back()];
+              stack.pop_back();
+              if(nd.hi<=a+1)
+                {
+                  //all knots are inside the target radius
+                  continue;
+                }
+              if(nd.lo>a && nd.width<=theta*(nd.center-sa))
+                {
+                  //far field, expanded about the group center:
+                  //  t0^(3/2) sum_j coeff_j (width/t0)^j M_j
+                  const T t0=nd.center-sa;
+                  const T q=nd.width/t0;
+                  const T t15=t0*sqrt(t0);
+                  const T* mom=&moments[(&nd-&nodes[0])*nk*nband];
+                  for(size_t k=0;k<nband;++k)
+                    {
+                      T sum=0;
+                      for(size_t j=nk;j-->0;)
+                        {
+                          sum=sum*q+coeff[j]*mom[j*nband+k];
+                        }
+                      g[k]+=t15*sum;
+                    }
+                  continue;
+                }
+              if(nd.lo>a && sa<=theta*slist[nd.lo])
+                {
+                  //far field, expanded about the origin, for groups much
+                  //wider than the target radius (e.g., logarithmic grids):
+                  //  sum_j coeff_j (-s_a/s_min)^j R_j
+                  const T q=-sa/slist[nd.lo];
+                  const T* rmom=&rmoments[(&nd-&nodes[0])*nk*nband];
+                  for(size_t k=0;k<nband;++k)
+                    {
+                      T sum=0;
+                      for(size_t j=nk;j-->0;)
+                        {
+                          sum=sum*q+coeff[j]*rmom[j*nband+k];
+                        }
+                      g[k]+=sum;
+                    }
+                  continue;
+                }
+              if(nd.left==0)
+                {
+                  //near field: direct summation
+                  for(size_t b=(nd.lo>a?nd.lo:a+1);b<nd.hi;++b)
+                    {
+                      const T t=slist[b]-sa;
+                      const T t15=t*sqrt(t);
+                      for(size_t k=0;k<nband;++k)
+                        {
+                          g[k]+=t15*jump[b*nband+k];
+                        }
+                    }
+                  continue;
+                }
+              stack.push_back(nd.right);
+              stack.push_back(nd.left);
+            }
+        }
+    }
+
+    static const T c=16*atan(T(1))/3;
+    result.resize(n*nband);
+    for(size_t i=0;i<n;++i)
+      {
+        for(size_t k=0;k<nband;++k)
+          {
+            result[i*nband+k]=c*(glist[i*nband+k]-glist[(i+1)*nband+k]);
+          }
+      }
+  }
+};
+
+#endif
@@ -0,0 +1,235 @@
+#ifndef AD_MODEL_HPP
+#define AD_MODEL_HPP
+/*
+  A model wrapper that provides the parameter derivatives of a model by
+  forward mode automatic differentiation
+
+  Holds the model instantiated on T for the values, and the same model
+  template instantiated on dual<T,N> for the derivatives, e.g.,
+    ad_model<double,double,double,7>(wang2012_model<double>(),
+                                     wang2012_model<dual<double,7> >())
+  Models with more than N parameters are differentiated N parameters at
+  a time.  The derivatives are exposed as param_derivative, so that
+  eval_model_derivative(), and therefore the Jacobians of chisq/vchisq
+  used by lm_method, work with any model template, including those
+  without closed-form derivatives.
+*/
+
+#include <core/fitter.hpp>
+#include "dual.hpp"
+#include "fused_model.hpp"
+#include "param_derivative.hpp"
+#include <vector>
+#include <string>
+
+namespace opt_utilities
+{
+  //the type of the x/y of a model instantiated on dual<T,N>
+  template <typename Tv,size_t N>
+  struct dual_of
+  {
+    typedef dual<Tv,N> type;
+  };
+
+  template <typename Tv,size_t N>
+  struct dual_of<std::vector<Tv>,N>
+  {
+    typedef std::vector<dual<Tv,N> > type;
+  };
+
+  //x as a constant
+  template <typename T,size_t N>
+  inline void ad_constant(const T& x,dual<T,N>& y)
+  {
+    y=dual<T,N>(x);
+  }
+
+  template <typename T,size_t N>
+  inline void ad_constant(const std::vector<T>& x,std::vector<dual<T,N> >& y)
+  {
+    y.resize(x.size());
+    for(size_t i=0;i<x.size();++i)
+      {
+        y[i]=dual<T,N>(x[i]);
+      }
+  }
+
+  //the k-th tangent of y
+  template <typename T,size_t N>
+  inline void ad_tangent(const dual<T,N>& y,size_t k,T& dy)
+  {
+    dy=y.tangent(k);
+  }
+
+  template <typename T,size_t N>
+  inline void ad_tangent(const std::vector<dual<T,N> >& y,size_t k,std::vector<T>& dy)
+  {
+    dy.resize(y.size());
+    for(size_t i=0;i<y.size();++i)
+      {
+        dy[i]=y[i].tangent(k);
+      }
+  }
+
+  //dy[j]=d(md.eval(x,p))/dp[j], for md instantiated on dual<T,N>
+  template <typename Tyd,typename Txd,typename T,size_t N,typename Tstr,
+            typename Ty,typename Tx>
+  void ad_eval_derivative(model<Tyd,Txd,std::vector<dual<T,N> >,Tstr>& md,
+                          const Tx& x,const std::vector<T>& p,std::vector<Ty>& dy)
+  {
+    Txd xd;
+    ad_constant(x,xd);
+    std::vector<dual<T,N> > pd(p.size());
+    dy.resize(p.size());
+    for(size_t j0=0;j0<p.size();j0+=N)
+      {
+        for(size_t j=0;j<p.size();++j)
+          {
+            pd[j]=j>=j0&&j<j0+N?dual<T,N>(p[j],j-j0):dual<T,N>(p[j]);
+          }
+        const Tyd yd(md.eval(xd,pd));
+        for(size_t j=j0;j<p.size()&&j<j0+N;++j)
+          {
+            ad_tangent(yd,j-j0,dy[j]);
+          }
+      }
+  }
+
+  template <typename Ty,typename Tx,typename T,size_t N,typename Tstr=std::string>
+  class ad_model
+    :public model<Ty,Tx,std::vector<T>,Tstr>,
+     public fused_model<Ty,Tx,std::vector<T> >,
+     public param_derivative<Ty,Tx,std::vector<T> >
+  {
+  public:
+    typedef std::vector<T> Tp;
+    typedef model<typename dual_of<Ty,N>::type,typename dual_of<Tx,N>::type,
+                  std::vector<dual<T,N> >,Tstr> dual_model;
+  private:
+    model<Ty,Tx,Tp,Tstr>* pmodel;
+    dual_model* pdmodel;
+
+  public:
+    ad_model()
+      :pmodel(NULL_PTR),pdmodel(NULL_PTR)
+    {}
+
+    ad_model(const model<Ty,Tx,Tp,Tstr>& m,const dual_model& md)
+      :pmodel(NULL_PTR),pdmodel(NULL_PTR)
+    {
+      attach_model(m,md);
+    }
+
+    ad_model(const ad_model& rhs)
+      :model<Ty,Tx,Tp,Tstr>(rhs),pmodel(NULL_PTR),pdmodel(NULL_PTR)
+    {
+      if(rhs.pmodel)
+        {
+          pmodel=rhs.pmodel->clone();
+        }
+      if(rhs.pdmodel)
+        {
+          pdmodel=rhs.pdmodel->clone();
+        }
+    }
+
+    ad_model& operator=(const ad_model& rhs)
+    {
+      if(this==&rhs)
+        {
+          return *this;
+        }
+      model<Ty,Tx,Tp,Tstr>::operator=(rhs);
+      release();
+      pmodel=rhs.pmodel?rhs.pmodel->clone():NULL_PTR;
+      pdmodel=rhs.pdmodel?rhs.pdmodel->clone():NULL_PTR;
+      return *this;
+    }
+
+    ~ad_model()
+    {
+      release();
+    }
+
+  private:
+    void release()
+    {
+      if(pmodel)
+        {
+          pmodel->destroy();
+        }
+      if(pdmodel)
+        {
+          pdmodel->destroy();
+        }
+      pmodel=NULL_PTR;
+      pdmodel=NULL_PTR;
+    }
+
+    model<Ty,Tx,Tp,Tstr>* do_clone()const
+    {
+      return new ad_model(*this);
+    }
+
+    const char* do_get_type_name()const
+    {
+      return pmodel?pmodel->get_type_name():"ad model";
+    }
+
+  public:
+    //attach the model, and the same model instantiated on dual<T,N>
+    void attach_model(const model<Ty,Tx,Tp,Tstr>& m,const dual_model& md)
+    {
+      release();
+      this->clear_param_info();
+      for(size_t i=0;i<m.get_num_params();++i)
+        {
+          this->push_param_info(m.get_param_info(i));
+        }
+      pmodel=m.clone();
+      pmodel->clear_param_modifier();
+      pdmodel=md.clone();
+      pdmodel->clear_param_modifier();
+    }
+
+    //the wrapped model
+    model<Ty,Tx,Tp,Tstr>& get_model()
+    {
+      return *pmodel;
+    }
+
+    const model<Ty,Tx,Tp,Tstr>& get_model()const
+    {
+      return *pmodel;
+    }
+
+  private:
+    bool do_meets_constraint(const Tp& p)const
+    {
+      //the limits are set on the wrapper, so pass them on
+      for(size_t i=0;i<this->get_num_params();++i)
+        {
+          pmodel->set_param_info(this->get_param_info(i));
+        }
+      return pmodel->meets_constraint(this->reform_param(p));
+    }
+
+    Ty do_eval(const Tx& x,const Tp& p)
+    {
+      return pmodel->eval(x,p);
+    }
+
+    void do_eval_into(const Tx& x,const Tp& p,Ty& y)
+    {
+      eval_model_into(*pmodel,x,p,y);
+    }
+
+    bool do_eval_derivative(const Tx& x,const Tp& p,std::vector<Ty>& dy)
+    {
+      ad_eval_derivative(*pdmodel,x,p,dy);
+      return true;
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef BATCH_FUNC_HPP
+#define BATCH_FUNC_HPP
+/*
+  Interface of the function objects that can evaluate many points in one
+  call, e.g., the spline interpolated cooling function and temperature
+  profiles.  Callers check for it with dynamic_cast, and fall back to
+  the one-point func_obj interface otherwise.
+*/
+
+#include <cstddef>
+
+namespace opt_utilities
+{
+  template <typename T>
+  class batch_func
+  {
+  public:
+    virtual ~batch_func()
+    {}
+
+    //y[i]=f(x[i]) for i<n, x sorted in ascending order
+    virtual void eval_batch(const T* x,T* y,size_t n)const=0;
+  };
+}
+
+#endif
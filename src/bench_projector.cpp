@@ -0,0 +1,98 @@
+/*
+  Micro-benchmark of the projection kernel: the packed triangular
+  operator (packed_tri.hpp) against the plain row-major double loop
+  Usage: bench_projector [repeat_scale]
+*/
+
+#include <iostream>
+#include <vector>
+#include <ctime>
+#include <cmath>
+#include <cstdlib>
+#include "packed_tri.hpp"
+
+using namespace std;
+
+//the old kernel: full n x n row-major matrix, pre-squared density
+static void project_loop(const vector<double>& op,const vector<double>& ne,
+			 vector<double>& result)
+{
+  const size_t n=ne.size();
+  vector<double> ne2(n);
+  for(size_t nsph=0;nsph<n;++nsph)
+    {
+      ne2[nsph]=ne[nsph]*ne[nsph];
+    }
+  for(size_t nrad=0;nrad<n;++nrad)
+    {
+      const double* oprow=&op[nrad*n];
+      double sum=0;
+      for(size_t nsph=nrad;nsph<n;++nsph)
+	{
+	  sum+=oprow[nsph]*ne2[nsph];
+	}
+      result[nrad]=sum;
+    }
+}
+
+static void project_packed(const packed_tri<double>& op,const vector<double>& ne,
+			   packed_tri<double>::vector_type& buf,vector<double>& result)
+{
+  const size_t n=ne.size();
+  buf.resize(op.padded_size());
+  op.load_sq(&ne[0],&buf[0]);
+  for(size_t nrad=0;nrad<n;++nrad)
+    {
+      result[nrad]=op.row_sum_sq(nrad,&buf[0]);
+    }
+}
+
+int main(int argc,char* argv[])
+{
+  double scale=argc>1?atof(argv[1]):1;
+  const size_t sizes[]={20,200,2000};
+  cout<<"#N\tloop(us)\tpacked(us)\tspeedup\tmax_rel_diff"<<endl;
+  for(size_t k=0;k<sizeof(sizes)/sizeof(sizes[0]);++k)
+    {
+      const size_t n=sizes[k];
+      vector<double> op(n*n,0);
+      packed_tri<double> pop;
+      pop.resize(n);
+      vector<double> ne(n);
+      srand(1);
+      for(size_t i=0;i<n;++i)
+	{
+	  ne[i]=pow(1+i*i/100.,-1.)*(1+rand()/(double)RAND_MAX);
+	  for(size_t j=i;j<n;++j)
+	    {
+	      op[i*n+j]=pop(i,j)=rand()/(double)RAND_MAX;
+	    }
+	}
+      //about 2e8 multiply-adds per kernel
+      const size_t repeat=size_t(scale*4e8/(n*(n+1)))+1;
+      vector<double> r1(n),r2(n);
+      packed_tri<double>::vector_type buf;
+
+      clock_t t0=clock();
+      for(size_t i=0;i<repeat;++i)
+	{
+	  project_loop(op,ne,r1);
+	}
+      clock_t t1=clock();
+      for(size_t i=0;i<repeat;++i)
+	{
+	  project_packed(pop,ne,buf,r2);
+	}
+      clock_t t2=clock();
+
+      double max_diff=0;
+      for(size_t i=0;i<n;++i)
+	{
+	  max_diff=max(max_diff,abs(r1[i]-r2[i])/abs(r1[i]));
+	}
+      double us1=double(t1-t0)/CLOCKS_PER_SEC/repeat*1e6;
+      double us2=double(t2-t1)/CLOCKS_PER_SEC/repeat*1e6;
+      cout<<n<<"\t"<<us1<<"\t"<<us2<<"\t"<<us1/us2<<"\t"<<max_diff<<endl;
+    }
+  return 0;
+}
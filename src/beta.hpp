@@ -6,7 +6,9 @@ namespace opt_utilities
 {
   template <typename T>
   class beta
-    :public model<std::vector<T>,std::vector<T>,std::vector<T> >
+    :public model<std::vector<T>,std::vector<T>,std::vector<T> >,
+     public fused_model<std::vector<T>,std::vector<T>,std::vector<T> >,
+     public param_derivative<std::vector<T>,std::vector<T>,std::vector<T> >
   {
   public:
     beta()
@@ -25,11 +27,22 @@ namespace opt_utilities
     std::vector<T> do_eval(const std::vector<T> & x,
 			   const std::vector<T>& p)
     {
-      T n0=std::abs(p[0]);
+      std::vector<T> result;
+      do_eval_into(x,p,result);
+      return result;
+    }
+
+    void do_eval_into(const std::vector<T> & x,
+		      const std::vector<T>& p,
+		      std::vector<T>& result)
+    {
+      using std::abs;
+      using std::pow;
+      T n0=abs(p[0]);
       T beta=p[1];
       T rc=p[2];
 
-      std::vector<T> result(x.size()-1);
+      result.resize(x.size()-1);
       for(size_t i=1;i<x.size();++i)
 	{
 	  T xi=(x[i]+x[i-1])/2;
@@ -37,7 +50,35 @@ namespace opt_utilities
 	  yi=n0*pow(1+xi*xi/rc/rc,-3./2.*beta);
 	  result[i-1]=yi;
 	}
-      return result;
+    }
+
+    bool do_eval_derivative(const std::vector<T>& x,
+			    const std::vector<T>& p,
+			    std::vector<std::vector<T> >& dy)
+    {
+      using std::abs;
+      using std::pow;
+      using std::log;
+      T n0=abs(p[0]);
+      T beta=p[1];
+      T rc=p[2];
+      T sn0=p[0]<0?-1:1;
+
+      dy.resize(3);
+      for(size_t j=0;j<3;++j)
+	{
+	  dy[j].resize(x.size()-1);
+	}
+      for(size_t i=1;i<x.size();++i)
+	{
+	  T xi=(x[i]+x[i-1])/2;
+	  T u=1+xi*xi/rc/rc;
+	  T f=pow(u,-3./2.*beta);
+	  dy[0][i-1]=sn0*f;
+	  dy[1][i-1]=-3./2.*log(u)*n0*f;
+	  dy[2][i-1]=3*beta*xi*xi/(rc*rc*rc)*n0*f/u;
+	}
+      return true;
     }
   };
 }
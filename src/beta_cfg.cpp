@@ -8,6 +8,12 @@ cfg_map parse_cfg_file(std::istream& is)
   cfg_map result;
   result.rmin_pixel=-1;
   result.rmin_kpc=-1;
+  result.omp_min_bins=0;
+  result.opt_method="powell";
+  result.fit_mode="normal";
+  result.num_starts=8;
+  result.fit_max_evals=0;
+  result.fit_max_seconds=0;
   for(;;)
     {
       std::string line;
@@ -62,6 +68,48 @@ cfg_map parse_cfg_file(std::istream& is)
 	  iss>>v;
 	  result.rmin_kpc=v;
 	}
+      else if(key=="omp_min_bins")
+	{
+	  size_t v;
+	  iss>>v;
+	  result.omp_min_bins=v;
+	}
+      else if(key=="opt_method")
+	{
+	  string value;
+	  iss>>value;
+	  result.opt_method=value;
+	}
+      else if(key=="fit_mode")
+	{
+	  string value;
+	  iss>>value;
+	  result.fit_mode=value;
+	}
+      else if(key=="num_starts")
+	{
+	  size_t v;
+	  iss>>v;
+	  result.num_starts=v;
+	}
+      else if(key=="fit_max_evals")
+	{
+	  size_t v;
+	  iss>>v;
+	  result.fit_max_evals=v;
+	}
+      else if(key=="fit_max_seconds")
+	{
+	  double v;
+	  iss>>v;
+	  result.fit_max_seconds=v;
+	}
+      else if(key=="fit_stage")
+	{
+	  string value;
+	  getline(iss,value);
+	  result.fit_stages.push_back(value);
+	}
       else
 	{
 	  std::vector<double> value;
@@ -5,6 +5,7 @@
 #include <vector>
 #include <string>
 #include <iostream>
+#include <cstddef>
 
 struct cfg_map
 {
@@ -15,6 +16,23 @@ struct cfg_map
   double cm_per_pixel;
   double rmin_kpc;
   double rmin_pixel;
+  //bin-count threshold of the OpenMP-parallel loops, 0 for the default
+  size_t omp_min_bins;
+  //optimization method, "powell" (default) or "lm"
+  std::string opt_method;
+  //"normal" (default), or "varpro" to solve the linear amplitudes
+  //(n0 and bkg, or bkg of the double-beta model) by variable projection
+  std::string fit_mode;
+  //number of starting points of the final double-beta fit; more than
+  //one copies the fitter once per thread (see multi_start.hpp)
+  size_t num_starts;
+  //evaluation and wall-clock (seconds) budgets of each fit, 0 for the
+  //defaults of fit_controller
+  size_t fit_max_evals;
+  double fit_max_seconds;
+  //the fields of the fit_stage lines, in order (see fit_schedule.hpp);
+  //empty for the default schedule of each tool
+  std::vector<std::string> fit_stages;
   std::map<std::string,std::vector<double> > param_map;
 };
 
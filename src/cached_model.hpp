@@ -0,0 +1,337 @@
+#ifndef CACHED_MODEL_HPP
+#define CACHED_MODEL_HPP
+/*
+  A model wrapper that memoizes the evaluations of another model
+
+  The results are kept in a bounded LRU cache keyed on the (x, p) pair,
+  which is looked up by a hash and then compared exactly, so a hit
+  returns a bit-identical result.  It is opt-in, e.g., to count how
+  often a fitting schedule re-evaluates the same parameters (line search
+  brackets, repeated fit() calls): the tools do not use it, since only a
+  few percent of their evaluations repeat (2% of the double-beta fit of
+  check_cached_model, which checks the hits bit for bit), and a miss
+  costs a hash, a search and the copies of x, p and y on top of the
+  model.
+  Note: the cache is not shared between copies of the wrapper.
+*/
+
+#include <core/fitter.hpp>
+#include "fused_model.hpp"
+#include "param_derivative.hpp"
+#include <vector>
+#include <list>
+#include <map>
+#include <cstring>
+#include <algorithm>
+
+namespace opt_utilities
+{
+  //FNV-1a hash of the bits of the keys
+  inline void cache_hash_combine(size_t& h,double v)
+  {
+    unsigned char bytes[sizeof(double)];
+    std::memcpy(bytes,&v,sizeof(double));
+    for(size_t i=0;i<sizeof(double);++i)
+      {
+        h^=bytes[i];
+        h*=1099511628211ULL;
+      }
+  }
+
+  template <typename T>
+  inline void cache_hash_combine(size_t& h,const std::vector<T>& v)
+  {
+    for(size_t i=0;i<v.size();++i)
+      {
+        cache_hash_combine(h,v[i]);
+      }
+  }
+
+  template <typename Ty,typename Tx,typename Tp,typename Tstr=std::string>
+  class cached_model
+    :public model<Ty,Tx,Tp,Tstr>,
+     public fused_model<Ty,Tx,Tp>,
+     public batch_model<Ty,Tx,Tp>,
+     public param_derivative<Ty,Tx,Tp>
+  {
+  private:
+    struct entry
+    {
+      size_t hash;
+      Tx x;
+      Tp p;
+      Ty y;
+    };
+    typedef typename std::list<entry>::iterator entry_iterator;
+
+    model<Ty,Tx,Tp,Tstr>* pmodel;
+    size_t capacity;
+    //most recently used first
+    std::list<entry> lru;
+    std::multimap<size_t,entry_iterator> index;
+    size_t hits;
+    size_t misses;
+
+  public:
+    cached_model()
+      :pmodel(NULL_PTR),capacity(256),hits(0),misses(0)
+    {}
+
+    explicit cached_model(const model<Ty,Tx,Tp,Tstr>& m,size_t cap=256)
+      :pmodel(NULL_PTR),capacity(cap),hits(0),misses(0)
+    {
+      attach_model(m);
+    }
+
+    //the cache itself is not copied
+    cached_model(const cached_model& rhs)
+      :model<Ty,Tx,Tp,Tstr>(rhs),pmodel(NULL_PTR),
+       capacity(rhs.capacity),hits(0),misses(0)
+    {
+      if(rhs.pmodel)
+        {
+          pmodel=rhs.pmodel->clone();
+        }
+    }
+
+    cached_model& operator=(const cached_model& rhs)
+    {
+      if(this==&rhs)
+        {
+          return *this;
+        }
+      model<Ty,Tx,Tp,Tstr>::operator=(rhs);
+      if(pmodel)
+        {
+          pmodel->destroy();
+        }
+      pmodel=rhs.pmodel?rhs.pmodel->clone():NULL_PTR;
+      capacity=rhs.capacity;
+      clear_cache();
+      return *this;
+    }
+
+    ~cached_model()
+    {
+      if(pmodel)
+        {
+          pmodel->destroy();
+        }
+    }
+
+  private:
+    model<Ty,Tx,Tp,Tstr>* do_clone()const
+    {
+      return new cached_model(*this);
+    }
+
+    const char* do_get_type_name()const
+    {
+      return pmodel?pmodel->get_type_name():"cached model";
+    }
+
+  public:
+    //attach the model whose evaluations are cached
+    void attach_model(const model<Ty,Tx,Tp,Tstr>& m)
+    {
+      if(pmodel)
+        {
+          pmodel->destroy();
+        }
+      this->clear_param_info();
+      for(size_t i=0;i<m.get_num_params();++i)
+        {
+          this->push_param_info(m.get_param_info(i));
+        }
+      pmodel=m.clone();
+      pmodel->clear_param_modifier();
+      clear_cache();
+    }
+
+    //the wrapped model, e.g., to reach the projector
+    model<Ty,Tx,Tp,Tstr>& get_model()
+    {
+      return *pmodel;
+    }
+
+    const model<Ty,Tx,Tp,Tstr>& get_model()const
+    {
+      return *pmodel;
+    }
+
+    void set_capacity(size_t cap)
+    {
+      capacity=cap;
+      while(lru.size()>capacity)
+        {
+          evict();
+        }
+    }
+
+    void clear_cache()
+    {
+      lru.clear();
+      index.clear();
+    }
+
+    size_t get_hits()const
+    {
+      return hits;
+    }
+
+    size_t get_misses()const
+    {
+      return misses;
+    }
+
+  private:
+    //remove the least recently used entry from the index
+    void unindex_last()
+    {
+      entry_iterator last=lru.end();
+      --last;
+      std::pair<typename std::multimap<size_t,entry_iterator>::iterator,
+        typename std::multimap<size_t,entry_iterator>::iterator>
+        r=index.equal_range(last->hash);
+      for(typename std::multimap<size_t,entry_iterator>::iterator i=r.first;
+          i!=r.second;++i)
+        {
+          if(i->second==last)
+            {
+              index.erase(i);
+              break;
+            }
+        }
+    }
+
+    void evict()
+    {
+      unindex_last();
+      lru.pop_back();
+    }
+
+    bool do_meets_constraint(const Tp& p)const
+    {
+      //the limits are set on the wrapper, so pass them on
+      for(size_t i=0;i<this->get_num_params();++i)
+        {
+          pmodel->set_param_info(this->get_param_info(i));
+        }
+      return pmodel->meets_constraint(this->reform_param(p));
+    }
+
+    Ty do_eval(const Tx& x,const Tp& p)
+    {
+      Ty y;
+      do_eval_into(x,p,y);
+      return y;
+    }
+
+    void do_eval_into(const Tx& x,const Tp& p,Ty& y)
+    {
+      const size_t h=key_hash(x,p);
+      if(lookup(h,x,p,y))
+        {
+          return;
+        }
+      eval_model_into(*pmodel,x,p,y);
+      store(h,x,p,y);
+    }
+
+    //the derivatives are not cached, but taken from the wrapped model
+    bool do_eval_derivative(const Tx& x,const Tp& p,std::vector<Ty>& dy)
+    {
+      return eval_model_derivative(*pmodel,x,p,dy);
+    }
+
+    //the misses are passed on to the wrapped model in a single batch
+    void do_eval_batch(const Tx& x,const std::vector<Tp>& ps,std::vector<Ty>& ys)
+    {
+      ys.resize(ps.size());
+      std::vector<size_t> hs(ps.size());
+      std::vector<size_t> miss_index;
+      std::vector<Tp> miss_p;
+      for(size_t k=0;k<ps.size();++k)
+        {
+          hs[k]=key_hash(x,ps[k]);
+          if(!lookup(hs[k],x,ps[k],ys[k]))
+            {
+              miss_index.push_back(k);
+              miss_p.push_back(ps[k]);
+            }
+        }
+      if(miss_p.empty())
+        {
+          return;
+        }
+      std::vector<Ty> miss_y;
+      eval_model_batch(*pmodel,x,miss_p,miss_y);
+      for(size_t j=0;j<miss_index.size();++j)
+        {
+          const size_t k=miss_index[j];
+          ys[k]=miss_y[j];
+          store(hs[k],x,ps[k],ys[k]);
+        }
+    }
+
+    size_t key_hash(const Tx& x,const Tp& p)const
+    {
+      size_t h=14695981039346656037ULL;
+      cache_hash_combine(h,x);
+      cache_hash_combine(h,p);
+      return h;
+    }
+
+    //copy the cached result into y, if any
+    bool lookup(size_t h,const Tx& x,const Tp& p,Ty& y)
+    {
+      std::pair<typename std::multimap<size_t,entry_iterator>::iterator,
+        typename std::multimap<size_t,entry_iterator>::iterator>
+        r=index.equal_range(h);
+      for(typename std::multimap<size_t,entry_iterator>::iterator i=r.first;
+          i!=r.second;++i)
+        {
+          entry_iterator e=i->second;
+          if(e->p==p && e->x==x)
+            {
+              ++hits;
+              lru.splice(lru.begin(),lru,e);
+              y=e->y;
+              return true;
+            }
+        }
+      ++misses;
+      return false;
+    }
+
+    void store(size_t h,const Tx& x,const Tp& p,const Ty& y)
+    {
+      if(capacity==0)
+        {
+          return;
+        }
+      //once full, the storage of the least recently used entry is reused
+      if(lru.size()>=capacity)
+        {
+          unindex_last();
+          lru.splice(lru.begin(),lru,--lru.end());
+        }
+      else
+        {
+          lru.push_front(entry());
+        }
+      entry& e=lru.front();
+      e.hash=h;
+      e.x=x;
+      e.p=p;
+      e.y=y;
+      index.insert(std::make_pair(h,lru.begin()));
+      while(lru.size()>capacity)
+        {
+          evict();
+        }
+    }
+  };
+}
+
+#endif
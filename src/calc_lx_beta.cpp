@@ -3,6 +3,17 @@
  *
  * Base on 'fit_beta_sbp.cpp' and supersede 'calc_lx.cpp'
  *
+ * With '-mc', also calculate their Monte Carlo errors as the loop of
+ * 'calc_lxfx.sh' did: each replica shuffles the temperature and surface
+ * brightness profiles, fits the temperature profile, interpolates the
+ * cooling function table of each band on it, refits the SBP from the
+ * solution of the fit to the data, and calculates the luminosity and flux.
+ * The replicas run in parallel (make OPENMP=1), and are written in their
+ * order to 'summary_lx.dat' and 'summary_fx.dat', after the values of
+ * the data themselves.  The random numbers of a replica depend only on
+ * the seed, recorded in those files, and on its number (see
+ * 'mc_profile.hpp').
+ *
  * Author: Junhua Gu
  */
 
@@ -22,7 +33,12 @@
 #include <methods/powell/powell_method.hpp>
 #include <core/freeze_param.hpp>
 #include <error_estimator/error_estimator.hpp>
-#include "spline.hpp"
+#include "spline_func_obj.hpp"
+#include "parallel.hpp"
+#include "lm_method.hpp"
+#include "fit_controller.hpp"
+#include "varpro.hpp"
+#include "mc_profile.hpp"
 
 using namespace std;
 using namespace opt_utilities;
@@ -35,44 +51,129 @@ double beta_func(double r, double n0, double rc, double beta)
   return abs(n0) * pow(1+r*r/rc/rc, -3./2.*abs(beta));
 }
 
-//A class enclosing the spline interpolation method
-class spline_func_obj
-  :public func_obj<double,double>
+typedef std::vector<double> dvec;
+
+//the flux in each band of the model of pj with the parameters p, within
+//the grid radii
+static dvec calc_flux(projector<double>& pj,const dvec& radii,const dvec& p,
+		      const std::vector<func_obj<double,double>*>& cfuncs)
+{
+  std::vector<dvec> mv_bands=pj.eval_cfuncs(radii,p,cfuncs);
+  dvec flux(cfuncs.size(),0);
+  for(size_t n=0;n<cfuncs.size();++n)
+    {
+      const dvec& mv=mv_bands[n];
+      for(size_t i=0;i<radii.size()-1;++i)
+	{
+	  double S=pi*(radii[i+1]+radii[i])*(radii[i+1]-radii[i]);
+	  flux[n]+=S*mv[i];
+	}
+    }
+  return flux;
+}
+
+//the inputs shared by the Monte Carlo replicas
+struct mc_setup
 {
-  //has an spline object
-  spline<double> spl;
-public:
-  //This function is used to calculate the intepolated value
-  double do_eval(const double& x)
-  {
-    return spl.get_value(x);
-  }
-
-  //we need this function, when this object is performing a clone of itself
-  spline_func_obj* do_clone()const
-  {
-    return new spline_func_obj(*this);
-  }
-
-public:
-  //add points to the spline object, after which the spline will be initialized
-  void add_point(double x,double y)
-  {
-    spl.push_point(x,y);
-  }
-
-  //before getting the intepolated value, the spline should be initialzied by calling this function
-  void gen_spline()
-  {
-    spl.gen_spline(0,0);
-  }
+  //the fits of the SBP, and the solution of the fit to the data
+  fit_controller<dvec,dvec,dvec,double> fc;
+  bool varpro;
+  dvec p0;
+  profile_data tprofile;
+  std::vector<tprofile_param> tparams;
+  profile_data sbp;
+  //number of the inner bins cut by rmin, and the radii of the rest
+  size_t num_cut;
+  dvec radii;
+  //the cooling function table of each band
+  std::vector<cfunc_table> cft;
+  //the grid within rout, and the luminosity distance
+  dvec rgrid;
+  double Dl;
+  counter_rng rng;
 };
 
+//run the replica No. id, refitting a copy of f0, and return its
+//luminosity and flux in each band; false if it fails
+static bool run_replica(const mc_setup& s,const fitter<dvec,dvec,dvec,double>& f0,size_t id,
+			dvec& lx,dvec& fx)
+{
+  const profile_data tprofile=shuffle_profile(s.tprofile,s.rng,id,mc_tprofile);
+  const profile_data sbp=shuffle_profile(s.sbp,s.rng,id,mc_sbp);
+
+  //temperature profile, and the cooling function of each band on it
+  std::vector<tprofile_param> tparams(s.tparams);
+  dvec xs,ts;
+  fit_tprofile(tprofile,tparams,1,xs,ts);
+  const size_t nbands=s.cft.size();
+  std::vector<spline_func_obj> cf_erg(nbands);
+  std::vector<func_obj<double,double>*> pcf_erg(nbands);
+  for(size_t n=0;n<nbands;++n)
+    {
+      for(size_t i=0;i<xs.size();++i)
+	{
+	  double cf;
+	  if(!s.cft[n].eval(ts[i],cf))
+	    {
+	      cerr<<"replica "<<id+1<<": temperature "<<ts[i]
+		  <<" is out of the cooling function table"<<endl;
+	      return false;
+	    }
+	  cf_erg[n].add_point(xs[i],cf);
+	}
+      cf_erg[n].gen_spline();
+      pcf_erg[n]=&cf_erg[n];
+    }
+
+  //density profile, from the solution of the fit to the data
+  const dvec sbps(sbp.y.begin()+s.num_cut,sbp.y.end());
+  const dvec sbpe(sbp.ye.begin()+s.num_cut,sbp.ye.end());
+  default_data_set<dvec,dvec> ds;
+  ds.add_data(data<dvec,dvec>(s.radii,sbps,sbpe,sbpe,s.radii,s.radii));
+  fitter<dvec,dvec,dvec,double> f(f0);
+  f.load_data(ds);
+  for(size_t i=0;i<s.p0.size();++i)
+    {
+      f.set_param_value(f.get_param_info(i).get_name(),s.p0[i]);
+    }
+  fit_controller<dvec,dvec,dvec,double> fc(s.fc);
+  fc.fit(f);
+  if(s.varpro)
+    {
+      dynamic_cast<varpro_chisq<double>&>(f.get_statistic()).solve_amplitudes();
+    }
+  dvec p=f.get_all_params();
+  p.back()=0;
+
+  fx=calc_flux(dynamic_cast<projector<double>&>(f.get_model()),s.rgrid,p,pcf_erg);
+  lx.resize(nbands);
+  for(size_t n=0;n<nbands;++n)
+    {
+      lx[n]=fx[n]*4*pi*s.Dl*s.Dl;
+    }
+  return true;
+}
+
 int main(int argc,char* argv[])
 {
-  if(argc<4)
+  //the bands end at -mc, which is followed by the inputs of the Monte
+  //Carlo errors, and a cooling function table for each band
+  int nargs=argc;
+  for(int n=3;n<argc;++n)
+    {
+      if(std::string(argv[n])=="-mc")
+	{
+	  nargs=n;
+	  break;
+	}
+    }
+  const bool mc=nargs<argc;
+  const int nbands=nargs-3;
+  if(nbands<1||(mc&&argc-nargs-5!=nbands))
     {
-      cerr<<argv[0]<<" <sbp.conf> <rout_kpc> <cfunc_erg> [cfunc2_erg ...]"<<endl;
+      cerr<<argv[0]<<" <sbp.conf> <rout_kpc> <cfunc_erg> [cfunc2_erg ...]"
+	  <<" [-mc <mass.conf> <number of replicas|<first>-<last>> <number of threads>"
+	  <<" <seed> <cfunc_table_erg> [cfunc2_table_erg ...]]"<<endl;
       return -1;
     }
   //initialize the parameters list
@@ -80,6 +181,11 @@ int main(int argc,char* argv[])
   assert(cfg_file.is_open());
   cfg_map cfg=parse_cfg_file(cfg_file);
 
+  if(cfg.omp_min_bins>0)
+    {
+      set_omp_min_bins(cfg.omp_min_bins);
+    }
+
   const double z=cfg.z;
 
   //initialize the radius list, sbp list and sbp error list
@@ -227,13 +333,36 @@ int main(int argc,char* argv[])
   a.set_cm_per_pixel(cm_per_pixel);
   a.attach_model(betao);
   f.set_model(a);
-  //chi^2 statistic
+  //chi^2 statistic, or with n0^2 and bkg solved by the linear least
+  //squares for each beta and rc (see varpro.hpp)
   vchisq<double> c;
   c.verbose(true);
   c.set_limit();
-  f.set_statistic(c);
+  varpro_chisq<double> vc;
+  vc.add_scale_param("n0",2);
+  vc.set_offset_param("bkg");
+  vc.verbose(true);
+  vc.set_limit();
+  const bool varpro=cfg.fit_mode=="varpro";
+  if(!varpro&&cfg.fit_mode!="normal")
+    {
+      cerr<<"unknown fit_mode: "<<cfg.fit_mode<<endl;
+      return -1;
+    }
+  if(varpro)
+    {
+      f.set_statistic(vc);
+    }
+  else
+    {
+      f.set_statistic(c);
+    }
   //optimization method
-  f.set_opt_method(powell_method<double,std::vector<double> >());
+  if(!set_opt_method_by_name(f,cfg.opt_method))
+    {
+      cerr<<"unknown opt_method: "<<cfg.opt_method<<endl;
+      return -1;
+    }
   //initialize the initial values
   /*
   double n0=0;
@@ -266,8 +395,34 @@ int main(int argc,char* argv[])
 	}
     }
 
-  f.fit();
-  f.fit();
+  //refit while it improves (twice at most), within the budgets
+  fit_controller<vector<double>,vector<double>,vector<double>,double> fc;
+  fc.set_max_fits(2);
+  if(cfg.fit_max_evals>0)
+    {
+      fc.set_max_evals(cfg.fit_max_evals);
+    }
+  if(cfg.fit_max_seconds>0)
+    {
+      fc.set_max_seconds(cfg.fit_max_seconds);
+    }
+  if(varpro)
+    {
+      f.set_param_modifier(freeze_param<vector<double>,vector<double>,vector<double>,std::string>("n0")+
+			   freeze_param<vector<double>,vector<double>,vector<double>,std::string>("bkg"));
+    }
+  //the fitter before the fit, which the Monte Carlo replicas refit
+  const fitter<vector<double>,vector<double>,vector<double>,double> f0(f);
+  fc.fit(f);
+  cerr<<"fit stopped: "<<fc.get_stop_reason_name()<<", after "
+      <<fc.get_num_fits()<<" fits and "<<fc.get_num_evals()<<" evaluations"<<endl;
+  if(varpro)
+    {
+      //set n0 and bkg to their solution, and go back to the plain chi^2
+      dynamic_cast<varpro_chisq<double>&>(f.get_statistic()).solve_amplitudes();
+      f.clear_param_modifier();
+      f.set_statistic(c);
+    }
   std::vector<double> p=f.get_all_params();
   /*
   n0=f.get_param_value("n0");
@@ -459,9 +614,11 @@ int main(int argc,char* argv[])
   double Dl=Da*(1+z)*(1+z);
   cout<<"dl="<<Dl/kpc<<endl;
 
-  for(int n=3;n<argc;++n)
+  //read the cooling functions of all bands, and project them at once
+  std::vector<spline_func_obj> cf_erg(nbands);
+  std::vector<func_obj<double,double>*> pcf_erg(nbands);
+  for(int n=3;n<nargs;++n)
     {
-      spline_func_obj cf_erg;
       for(ifstream ifs(argv[n]);;)
 	{
 	  assert(ifs.is_open());
@@ -473,25 +630,160 @@ int main(int argc,char* argv[])
 	    }
 	  //cerr<<x<<"\t"<<y<<endl;
 
-	  cf_erg.add_point(x,y);//change with source
+	  cf_erg[n-3].add_point(x,y);//change with source
 	}
-      cf_erg.gen_spline();
-
-      projector<double>& pj=dynamic_cast<projector<double>&>(f.get_model());
-      pj.attach_cfunc(cf_erg);
-
+      cf_erg[n-3].gen_spline();
+      pcf_erg[n-3]=&cf_erg[n-3];
+    }
 
+  projector<double>& pj=dynamic_cast<projector<double>&>(f.get_model());
+  const std::vector<double> flux=calc_flux(pj,radii,p,pcf_erg);
 
-      mv=f.eval_model_raw(radii,p);
-      double flux_erg=0;
-      for(size_t i=0;i<radii.size()-1;++i)
-	{
-	  double S=pi*(radii[i+1]+radii[i])*(radii[i+1]-radii[i]);
-	  flux_erg+=S*mv[i];
-	}
+  for(int n=3;n<nargs;++n)
+    {
+      double flux_erg=flux[n-3];
       cout<<flux_erg*4*pi*Dl*Dl<<endl;
       cout<<flux_erg<<endl;
       param_output<<"Lx"<<n-2<<"\t"<<flux_erg*4*pi*Dl*Dl<<endl;
       param_output<<"Fx"<<n-2<<"\t"<<flux_erg<<endl;
     }
+  if(!mc)
+    {
+      return 0;
+    }
+
+  //Monte Carlo errors
+  size_t first_replica,num_replicas;
+  if(!parse_replicas(argv[nargs+2],first_replica,num_replicas))
+    {
+      cerr<<"invalid replicas: "<<argv[nargs+2]<<endl;
+      return -1;
+    }
+  const int num_threads=atoi(argv[nargs+3]);
+  const unsigned long long seed=strtoull(argv[nargs+4],NULL_PTR,10);
+#ifdef _OPENMP
+  if(num_threads>0)
+    {
+      omp_set_num_threads(num_threads);
+    }
+#else
+  if(num_threads>1)
+    {
+      cerr<<"built without OpenMP, the replicas run serially"<<endl;
+    }
+#endif
+  mc_setup s;
+  s.rng=counter_rng(seed);
+  std::map<std::string,std::string> mass_cfg;
+  if(!read_mass_cfg(argv[nargs+1],mass_cfg))
+    {
+      cerr<<"cannot open file: "<<argv[nargs+1]<<endl;
+      return -1;
+    }
+  if(!read_profile(mass_cfg["tprofile_data"],s.tprofile)
+     ||!read_tprofile_params(mass_cfg["tprofile_cfg"],s.tparams)
+     ||!read_profile(cfg.sbp_data,s.sbp))
+    {
+      cerr<<"cannot read the profiles: "<<mass_cfg["tprofile_data"]<<", "
+	  <<mass_cfg["tprofile_cfg"]<<", "<<cfg.sbp_data<<endl;
+      return -1;
+    }
+  s.cft.resize(nbands);
+  for(int n=0;n<nbands;++n)
+    {
+      if(!s.cft[n].load(argv[nargs+5+n]))
+	{
+	  cerr<<"cannot read the cooling function table: "<<argv[nargs+5+n]<<endl;
+	  return -1;
+	}
+    }
+  s.fc=fc;
+  s.varpro=varpro;
+  s.p0=f.get_all_params();
+  s.num_cut=sbps_inner_cut_size;
+  s.radii.assign(radii_all.begin()+s.num_cut,radii_all.end());
+  s.rgrid=radii;
+  s.Dl=Dl;
+  //the replicas refit quietly
+  vchisq<double> qc(c);
+  qc.verbose(false);
+  varpro_chisq<double> qvc(vc);
+  qvc.verbose(false);
+  fitter<vector<double>,vector<double>,vector<double>,double> fq(f0);
+  if(varpro)
+    {
+      fq.set_statistic(qvc);
+    }
+  else
+    {
+      fq.set_statistic(qc);
+    }
+  //the fit to the temperature profile, from whose solution the replicas
+  //start with a single start
+  try
+    {
+      dvec xs,ts;
+      fit_tprofile(s.tprofile,s.tparams,8,xs,ts);
+    }
+  catch(const opt_exception& e)
+    {
+      cerr<<"the fit to the temperature profile failed: "<<e.what()<<endl;
+      return -1;
+    }
+
+  ofstream summary_lx("summary_lx.dat");
+  ofstream summary_fx("summary_fx.dat");
+  //a comment, from which the run can be repeated
+  summary_lx<<"# seed "<<seed<<endl;
+  summary_fx<<"# seed "<<seed<<endl;
+  cerr<<"seed: "<<seed<<endl;
+  for(int n=0;n<nbands;++n)
+    {
+      summary_lx<<(n>0?" ":"")<<flux[n]*4*pi*Dl*Dl;
+      summary_fx<<(n>0?" ":"")<<flux[n];
+    }
+  summary_lx<<endl;
+  summary_fx<<endl;
+  const double t0=wall_time();
+  size_t num_failed=0;
+#ifdef _OPENMP
+#pragma omp parallel for ordered schedule(dynamic)
+#endif
+  for(int i=0;i<int(num_replicas);++i)
+    {
+      dvec lx,fx;
+      bool ok=false;
+      try
+	{
+	  ok=run_replica(s,fq,first_replica+i,lx,fx);
+	}
+      catch(const opt_exception& e)
+	{
+	  cerr<<"replica "<<first_replica+i+1<<": "<<e.what()<<endl;
+	}
+      //written in the order of the replicas
+#ifdef _OPENMP
+#pragma omp ordered
+#endif
+      {
+	if(ok)
+	  {
+	    for(int n=0;n<nbands;++n)
+	      {
+		summary_lx<<(n>0?" ":"")<<lx[n];
+		summary_fx<<(n>0?" ":"")<<fx[n];
+	      }
+	    summary_lx<<endl;
+	    summary_fx<<endl;
+	  }
+	else
+	  {
+	    ++num_failed;
+	  }
+	cerr<<"## "<<first_replica+i+1<<" / "<<first_replica+num_replicas<<" ##"<<endl;
+      }
+    }
+  cerr<<num_replicas-num_failed<<" of "<<num_replicas<<" replicas done in "
+      <<wall_time()-t0<<" s"<<endl;
+  return num_failed<num_replicas?0:1;
 }
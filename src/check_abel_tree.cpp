@@ -0,0 +1,80 @@
+/*
+  Accuracy check of the O(N log N) projection engine (abel_tree.hpp)
+  against the exact shell volumes of the cached volume matrix, on
+  uniform and logarithmic grids, at the default tolerance
+  Usage: check_abel_tree
+  Returns non-zero if a relative error exceeds the tolerance.
+*/
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "beta.hpp"
+
+using namespace std;
+using namespace opt_utilities;
+
+//the largest relative difference of the projection of a beta model
+//on the grid x by the fast engine, from that by the volume matrix
+static double max_rel_error(const vector<double>& x,double& tol)
+{
+  projector<double> exact;
+  exact.attach_model(beta<double>());
+  exact.set_cm_per_pixel(1);
+  exact.set_fast_threshold(x.size());
+  projector<double> fast(exact);
+  fast.set_fast_threshold(1);
+  tol=fast.get_fast_tolerance();
+
+  vector<double> p(4);
+  p[0]=1e-2;
+  p[1]=.6;
+  p[2]=x[x.size()/20];
+  //no background, so that the outer bins are not masked by it
+  p[3]=0;
+  const vector<double> y0=exact.eval(x,p);
+  const vector<double> y1=fast.eval(x,p);
+  double max_err=0;
+  for(size_t i=0;i<y0.size();++i)
+    {
+      max_err=max(max_err,abs(y1[i]-y0[i])/abs(y0[i]));
+    }
+  return max_err;
+}
+
+int main()
+{
+  const size_t sizes[]={1000,3000};
+  bool ok=true;
+  cout<<"#grid\tN\tmax_rel_err\ttolerance"<<endl;
+  for(size_t k=0;k<sizeof(sizes)/sizeof(sizes[0]);++k)
+    {
+      const size_t n=sizes[k];
+      vector<double> uniform(n+1),logarithmic(n+1);
+      logarithmic[0]=0;
+      for(size_t i=0;i<=n;++i)
+	{
+	  uniform[i]=i;
+	  if(i>0)
+	    {
+	      //from 1 to 1e4
+	      logarithmic[i]=pow(10.,4.*(i-1)/(n-1));
+	    }
+	}
+      const char* names[]={"uniform","log"};
+      const vector<double>* grids[]={&uniform,&logarithmic};
+      for(size_t g=0;g<2;++g)
+	{
+	  double tol;
+	  const double err=max_rel_error(*grids[g],tol);
+	  cout<<names[g]<<"\t"<<n<<"\t"<<err<<"\t"<<tol<<endl;
+	  if(!(err<=tol))
+	    {
+	      cerr<<"FAILED: "<<names[g]<<" grid, N="<<n<<endl;
+	      ok=false;
+	    }
+	}
+    }
+  return ok?0:1;
+}
@@ -0,0 +1,167 @@
+/*
+  Check of the memoizing model wrapper (cached_model.hpp): the
+  double-beta fit of the SBP tool, on a synthetic profile, is run on the
+  projector and on the projector wrapped in a cached_model, and every
+  evaluation of the wrapper is compared with that of the projector
+  Usage: check_cached_model
+  Returns non-zero if a cached result, or the fitted parameters, differ
+  in any bit.
+*/
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include "projector.hpp"
+#include "dbeta.hpp"
+#include "vchisq.hpp"
+#include "cached_model.hpp"
+#include <data_sets/default_data_set.hpp>
+#include <methods/powell/powell_method.hpp>
+#include <core/freeze_param.hpp>
+
+using namespace std;
+using namespace opt_utilities;
+
+typedef vector<double> dvec;
+typedef fitter<dvec,dvec,dvec,double> dfitter;
+
+//a cached_model of m, and m itself evaluated at each call, to count
+//the results that differ
+class checked_model
+  :public model<dvec,dvec,dvec>,
+   public fused_model<dvec,dvec,dvec>
+{
+public:
+  cached_model<dvec,dvec,dvec> cached;
+  projector<double> plain;
+  size_t num_checked;
+  size_t num_differ;
+
+  explicit checked_model(const projector<double>& m)
+    :cached(m),plain(m),num_checked(0),num_differ(0)
+  {
+    for(size_t i=0;i<m.get_num_params();++i)
+      {
+        this->push_param_info(m.get_param_info(i));
+      }
+  }
+
+private:
+  model<dvec,dvec,dvec>* do_clone()const
+  {
+    return new checked_model(*this);
+  }
+
+  bool do_meets_constraint(const dvec& p)const
+  {
+    return cached.meets_constraint(this->reform_param(p));
+  }
+
+  dvec do_eval(const dvec& x,const dvec& p)
+  {
+    dvec y;
+    do_eval_into(x,p,y);
+    return y;
+  }
+
+  //the path of both eval() and the fused evaluations of vchisq
+  void do_eval_into(const dvec& x,const dvec& p,dvec& y)
+  {
+    eval_model_into(cached,x,p,y);
+    const dvec y0(plain.eval(x,p));
+    ++num_checked;
+    if(y!=y0)
+      {
+        ++num_differ;
+      }
+  }
+};
+
+//the radius grid of the profile, with the zero point
+static dvec make_grid(size_t n)
+{
+  dvec x(n+1);
+  for(size_t i=0;i<=n;++i)
+    {
+      x[i]=i*(i+10.)/10;
+    }
+  return x;
+}
+
+//the two stages of the double-beta fit of fit_dbeta_sbp, first with
+//beta and rc frozen, then with all parameters thawed, refitted twice
+static dvec fit_dbeta(const model<dvec,dvec,dvec>& m,const data_set<dvec,dvec>& ds,
+		      dfitter& f)
+{
+  vchisq<double> c;
+  c.verbose(false);
+  c.set_limit();
+  f.load_data(ds);
+  f.set_model(m);
+  f.set_statistic(c);
+  f.set_opt_method(powell_method<double,dvec>());
+  f.set_param_value("n01",5e-3);
+  f.set_param_value("rc1",30);
+  f.set_param_value("beta1",.7);
+  f.set_param_value("n02",1e-3);
+  f.set_param_value("rc2",100);
+  f.set_param_value("beta2",.7);
+  f.set_param_value("bkg",0);
+  f.set_param_modifier(freeze_param<dvec,dvec,dvec,string>("beta1")+
+                       freeze_param<dvec,dvec,dvec,string>("beta2")+
+                       freeze_param<dvec,dvec,dvec,string>("rc1")+
+                       freeze_param<dvec,dvec,dvec,string>("rc2"));
+  f.fit();
+  f.clear_param_modifier();
+  f.fit();
+  return f.fit();
+}
+
+int main()
+{
+  const dvec x(make_grid(40));
+  projector<double> a;
+  a.attach_model(dbeta<double>());
+  a.set_cm_per_pixel(1);
+
+  //the profile of a known double-beta, with 5% errors and a scatter
+  dvec p0;
+  p0.push_back(1e-2);
+  p0.push_back(.65);
+  p0.push_back(8);
+  p0.push_back(2e-3);
+  p0.push_back(.8);
+  p0.push_back(60);
+  p0.push_back(1e-7);
+  const dvec y0(a.eval(x,p0));
+  dvec y(y0.size()),ye(y0.size());
+  for(size_t i=0;i<y0.size();++i)
+    {
+      ye[i]=.05*y0[i];
+      y[i]=y0[i]+ye[i]*std::sin(3.*i);
+    }
+  default_data_set<dvec,dvec> ds;
+  ds.add_data(data<dvec,dvec>(x,y,ye,ye,x,x));
+
+  dfitter f;
+  const dvec p=fit_dbeta(a,ds,f);
+  dfitter fc;
+  const dvec pc=fit_dbeta(checked_model(a),ds,fc);
+  const checked_model& cm=dynamic_cast<const checked_model&>(fc.get_model());
+  cout<<"#evaluations\thits\tmisses\tdiffer"<<endl;
+  cout<<cm.num_checked<<"\t"<<cm.cached.get_hits()<<"\t"<<cm.cached.get_misses()
+      <<"\t"<<cm.num_differ<<endl;
+  bool ok=true;
+  if(cm.num_differ!=0||cm.cached.get_hits()+cm.cached.get_misses()!=cm.num_checked)
+    {
+      cerr<<"FAILED: cached results differ from the projector"<<endl;
+      ok=false;
+    }
+  if(pc!=p)
+    {
+      cerr<<"FAILED: fitted parameters differ with the cache"<<endl;
+      ok=false;
+    }
+  return ok?0:1;
+}
@@ -0,0 +1,254 @@
+/*
+  Consistency check of the closed-form parameter derivatives
+  (param_derivative.hpp) of beta, dbeta, dbeta2, nfw, wang2012_model and
+  the projector (exact and fast engines), also through a frozen
+  parameter and transform_param, against central differences, and
+  against the forward mode AD of the same models (ad_model.hpp)
+  Usage: check_derivatives
+  Returns non-zero if a derivative is off by more than the tolerance,
+  relative to the largest of that parameter.
+*/
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <algorithm>
+#include "beta.hpp"
+#include "dbeta.hpp"
+#include "nfw.hpp"
+#include "wang2012_model.hpp"
+#include "transform_param.hpp"
+#include "ad_model.hpp"
+#include <core/freeze_param.hpp>
+
+using namespace std;
+using namespace opt_utilities;
+
+typedef vector<double> dvec;
+
+static const double tolerance=1e-6;
+//of the closed-form derivatives from those by AD, to rounding (and the
+//cancellations in S_i=G(i)-G(i+1) of the fast engine)
+static const double ad_tolerance=1e-10;
+//tangents per AD pass, fewer than the parameters of most models, so
+//that they take several passes
+static const size_t nad=4;
+typedef dual<double,nad> ad_double;
+typedef vector<ad_double> ad_dvec;
+
+//the values of a scalar or vector model output, one after another
+static void append(dvec& out,double y)
+{
+  out.push_back(y);
+}
+
+static void append(dvec& out,const dvec& y)
+{
+  out.insert(out.end(),y.begin(),y.end());
+}
+
+//the largest error of the derivatives of m at the free parameters p, at
+//the points xs; false if m gives none, or not one per free parameter
+template <typename Ty,typename Tx>
+static bool check_model(const string& name,model<Ty,Tx,dvec,string>& m,
+			const vector<Tx>& xs,const dvec& p,bool& ok)
+{
+  double max_err=0;
+  for(size_t j=0;j<p.size();++j)
+    {
+      dvec an,fd;
+      const double h=1e-4*max(abs(p[j]),1e-3);
+      dvec p1(p),p2(p);
+      p1[j]+=h;
+      p2[j]-=h;
+      for(size_t i=0;i<xs.size();++i)
+	{
+	  vector<Ty> dy;
+	  if(!eval_model_derivative(m,xs[i],p,dy)||dy.size()!=p.size())
+	    {
+	      cerr<<"FAILED: "<<name<<" gives no derivatives"<<endl;
+	      ok=false;
+	      return false;
+	    }
+	  append(an,dy[j]);
+	  dvec y1,y2;
+	  append(y1,m.eval(xs[i],p1));
+	  append(y2,m.eval(xs[i],p2));
+	  for(size_t k=0;k<y1.size();++k)
+	    {
+	      fd.push_back((y1[k]-y2[k])/(p1[j]-p2[j]));
+	    }
+	}
+      double scale=0,err=0;
+      for(size_t k=0;k<an.size();++k)
+	{
+	  scale=max(scale,abs(an[k]));
+	  err=max(err,abs(an[k]-fd[k]));
+	}
+      max_err=max(max_err,scale>0?err/scale:err);
+    }
+  cout<<name<<"\t"<<p.size()<<"\t"<<max_err<<endl;
+  if(!(max_err<=tolerance))
+    {
+      cerr<<"FAILED: "<<name<<endl;
+      ok=false;
+    }
+  return true;
+}
+
+//the largest difference of the closed-form derivatives of m from those
+//of the same model md on dual numbers, at the points xs
+template <typename Ty,typename Tx,typename Tyd,typename Txd>
+static void check_ad(const string& name,model<Ty,Tx,dvec,string>& m,
+		     const model<Tyd,Txd,ad_dvec,string>& md,
+		     const vector<Tx>& xs,const dvec& p,bool& ok)
+{
+  ad_model<Ty,Tx,double,nad> am(m,md);
+  double max_err=0;
+  for(size_t i=0;i<xs.size();++i)
+    {
+      vector<Ty> dy,dy_ad;
+      if(!eval_model_derivative(m,xs[i],p,dy)||!eval_model_derivative(am,xs[i],p,dy_ad))
+	{
+	  cerr<<"FAILED: "<<name<<" gives no derivatives"<<endl;
+	  ok=false;
+	  return;
+	}
+      for(size_t j=0;j<p.size();++j)
+	{
+	  dvec an,ad;
+	  append(an,dy[j]);
+	  append(ad,dy_ad[j]);
+	  double scale=0,err=0;
+	  for(size_t k=0;k<an.size();++k)
+	    {
+	      scale=max(scale,abs(an[k]));
+	      err=max(err,abs(an[k]-ad[k]));
+	    }
+	  max_err=max(max_err,scale>0?err/scale:err);
+	}
+    }
+  cout<<name<<" AD\t"<<p.size()<<"\t"<<max_err<<endl;
+  if(!(max_err<=ad_tolerance))
+    {
+      cerr<<"FAILED: "<<name<<" AD"<<endl;
+      ok=false;
+    }
+}
+
+//the radius grid of the profiles, with the zero point
+static dvec make_grid(size_t n)
+{
+  dvec x(n+1);
+  for(size_t i=0;i<=n;++i)
+    {
+      x[i]=i*(i+10.)/10;
+    }
+  return x;
+}
+
+//the projector of the density model m (md on dual numbers) on a grid
+//of n bins, with the fast engine if fast
+static void check_projector(const string& name,
+			    const model<dvec,dvec,dvec,string>& m,
+			    const model<ad_dvec,ad_dvec,ad_dvec,string>& md,const dvec& pm,
+			    size_t n,bool fast,bool& ok)
+{
+  projector<double> a;
+  a.attach_model(m);
+  a.set_cm_per_pixel(1);
+  a.set_fast_threshold(fast?1:n+1);
+  //the truncation of the fast engine, which is checked by
+  //check_abel_tree, kept out of the differences
+  a.set_fast_tolerance(1e-12);
+  projector<ad_double> ad;
+  ad.attach_model(md);
+  ad.set_cm_per_pixel(1);
+  ad.set_fast_threshold(fast?1:n+1);
+  ad.set_fast_tolerance(1e-12);
+  const vector<dvec> xs(1,make_grid(n));
+  dvec p(pm);
+  p.push_back(1e-3);
+  const string engine=fast?" (fast)":" (exact)";
+  check_model(name+engine,a,xs,p,ok);
+  check_ad(name+engine,a,ad,xs,p,ok);
+
+  //with the core radius frozen, as the first stage of the dbeta fits
+  const string rc=a.get_param_info(0).get_name()=="n0"?"rc":"rc1";
+  dvec pf(p);
+  pf[a.get_param_order(rc)]=a.get_param_info(rc).get_value();
+  a.set_param_modifier(freeze_param<dvec,dvec,dvec,string>(rc));
+  check_model(name+engine+" "+rc+" frozen",a,xs,a.deform_param(pf),ok);
+
+  //fitted through the limits, by transform_param
+  a.set_param_modifier(transform_param<dvec,dvec,dvec,string>());
+  check_model(name+engine+" transformed",a,xs,a.deform_param(p),ok);
+  a.clear_param_modifier();
+}
+
+int main()
+{
+  bool ok=true;
+  cout<<"#model\tnum_params\tmax_rel_err"<<endl;
+  const vector<dvec> grid(1,make_grid(40));
+
+  beta<double> b;
+  dvec pb;
+  pb.push_back(1e-2);
+  pb.push_back(.6);
+  pb.push_back(20);
+  check_model("beta",b,grid,pb,ok);
+  check_ad("beta",b,beta<ad_double>(),grid,pb,ok);
+
+  dbeta<double> db;
+  dvec pdb;
+  pdb.push_back(1e-2);
+  pdb.push_back(.7);
+  pdb.push_back(10);
+  pdb.push_back(2e-3);
+  pdb.push_back(.55);
+  pdb.push_back(60);
+  check_model("dbeta",db,grid,pdb,ok);
+  check_ad("dbeta",db,dbeta<ad_double>(),grid,pdb,ok);
+
+  dbeta2<double> db2;
+  dvec pdb2;
+  pdb2.push_back(1e-2);
+  pdb2.push_back(10);
+  pdb2.push_back(2e-3);
+  pdb2.push_back(60);
+  pdb2.push_back(.6);
+  check_model("dbeta2",db2,grid,pdb2,ok);
+  check_ad("dbeta2",db2,dbeta2<ad_double>(),grid,pdb2,ok);
+
+  dvec radii;
+  for(double r=10;r<3000;r*=1.5)
+    {
+      radii.push_back(r);
+    }
+  nfw<double> nf;
+  dvec pn;
+  pn.push_back(1e7);
+  pn.push_back(300);
+  check_model("nfw",nf,radii,pn,ok);
+  check_ad("nfw",nf,nfw<ad_double>(),radii,pn,ok);
+
+  wang2012_model<double> w;
+  dvec pw;
+  pw.push_back(5);
+  pw.push_back(1.66);
+  pw.push_back(.45);
+  pw.push_back(1500);
+  pw.push_back(50);
+  pw.push_back(.49);
+  pw.push_back(.5);
+  check_model("wang2012",w,radii,pw,ok);
+  check_ad("wang2012",w,wang2012_model<ad_double>(),radii,pw,ok);
+
+  check_projector("projector(beta)",b,beta<ad_double>(),pb,60,false,ok);
+  check_projector("projector(beta)",b,beta<ad_double>(),pb,60,true,ok);
+  check_projector("projector(dbeta)",db,dbeta<ad_double>(),pdb,60,false,ok);
+  check_projector("projector(dbeta)",db,dbeta<ad_double>(),pdb,60,true,ok);
+  return ok?0:1;
+}
@@ -14,13 +14,15 @@
 #include <vector>
 #include <misc/optvec.hpp>
 #include <cmath>
+#include "progress_reporter.hpp"
+#include "residual_func.hpp"
+#include "param_derivative.hpp"
 
 using std::cerr;
 using std::endl;
 
 namespace opt_utilities
 {
-  static const int display_interval=10;
   /**
      \brief chi-square statistic
      \tparam Ty the return type of model
@@ -36,7 +38,8 @@ namespace opt_utilities
   };
   template<>
   class chisq<double,double,std::vector<double>,double,std::string>
-    :public statistic<double,double,std::vector<double> ,double,std::string>
+    :public statistic<double,double,std::vector<double> ,double,std::string>,
+     public residual_func<double>
   {
   public:
     typedef double Ty;
@@ -47,6 +50,7 @@ namespace opt_utilities
   private:
     bool verb;
     bool limit_bound;
+    progress_reporter progress;
 
     statistic<Ty,Tx,Tp,Ts,Tstr>* do_clone()const
     {
@@ -80,124 +84,139 @@ namespace opt_utilities
 
     Ty do_eval(const Tp& p)
     {
-      if(limit_bound)
+      Ty result=chi2(this->p_fitter->get_model(),p);
+      if(verb&&progress.tick())
 	{
-	  Tp p1=this->get_fitter().get_model().reform_param(p);
-	  for(size_t i=0;i<p1.size();++i)
-	    {
-	      if(p1[i]>this->get_fitter().get_param_info(i).get_upper_limit()||
-		 p1[i]<this->get_fitter().get_param_info(i).get_lower_limit())
-		{
-		  return 1e99;
-		}
-	    }
+	  progress.report(cerr,result,p);
 	}
-      Ty result(0);
-      std::vector<float> vx;
-      std::vector<float> vy;
-      std::vector<float> vye1;
-      std::vector<float> vye2;
-      std::vector<float> my;
-      float xmin=1e99,xmax=-1e99,ymin=1e99,ymax=-1e99;
-      int n=0;
-      if(verb)
+      return result;
+    }
+
+    //chi^2 of each of the parameter vectors ps, e.g., for the grid scans
+    //and the multiple starts; each thread evaluates its share with its
+    //own clone of the model
+    void eval_batch(const std::vector<Tp>& ps,std::vector<Ts>& result)
+    {
+      result.resize(ps.size());
+      const model<Ty,Tx,Tp,Tstr>& m=this->get_fitter().get_model();
+#ifdef _OPENMP
+#pragma omp parallel if(ps.size()>1)
+#endif
+      {
+	model<Ty,Tx,Tp,Tstr>* pm=m.clone();
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+	for(int k=0;k<(int)ps.size();++k)
+	  {
+	    result[k]=chi2(*pm,ps[k]);
+	  }
+	pm->destroy();
+      }
+    }
+
+    //residuals of the data points, (y_model-y_obs)/sigma
+    bool eval_residuals(const Tp& p,std::vector<Ty>& r)
+    {
+      model<Ty,Tx,Tp,Tstr>& m=this->p_fitter->get_model();
+      if(limit_bound&&!within_limits(m,m.reform_param(p)))
 	{
-	  n++;
-	  if(n%display_interval==0)
-	    {
-	      vx.resize(this->get_data_set().size());
-	      vy.resize(this->get_data_set().size());
-	      vye1.resize(this->get_data_set().size());
-	      vye2.resize(this->get_data_set().size());
-	      my.resize(this->get_data_set().size());
-	    }
+	  return false;
 	}
-
-      for(int i=(this->get_data_set()).size()-1;i>=0;--i)
+      const data_set<Ty,Tx>& ds=this->get_data_set();
+      r.resize(ds.size());
+      for(size_t i=0;i<ds.size();++i)
 	{
+	  r[i]=residual(m,ds.get_data(i),p);
+	}
+      return true;
+    }
 
+    //Jacobian of the residuals from the derivatives of the model; not
+    //available with the x errors, whose sigma depends on the slope
+    bool eval_jacobian(const Tp& p,std::vector<Ty>& jac)
+    {
 #ifdef HAVE_X_ERROR
-	  Tx x1=this->get_data_set().get_data(i).get_x()-this->get_data_set().get_data(i).get_x_lower_err();
-	  Tx x2=this->get_data_set().get_data(i).get_x()+this->get_data_set().get_data(i).get_x_upper_err();
-	  Tx x=this->get_data_set().get_data(i).get_x();
-	  Ty errx1=(this->eval_model(x1,p)-this->eval_model(x,p));
-	  Ty errx2=(this->eval_model(x2,p)-this->eval_model(x,p));
-	  //Ty errx=0;
+      return false;
 #else
-	  Ty errx1=0;
-	  Ty errx2=0;
-#endif
-
-	  Ty y_model=this->eval_model(this->get_data_set().get_data(i).get_x(),p);
-	  Ty y_obs=this->get_data_set().get_data(i).get_y();
-	  Ty y_err;
-
-	  Ty errx=0;
-	  if(errx1<errx2)
+      model<Ty,Tx,Tp,Tstr>& m=this->p_fitter->get_model();
+      const data_set<Ty,Tx>& ds=this->get_data_set();
+      const size_t np=p.size();
+      const param_modifier<Ty,Tx,Tp,Tstr>* pm=find_param_modifier(m);
+      std::vector<Ty> dy;
+      jac.resize(ds.size()*np);
+      for(size_t i=0;i<ds.size();++i)
+	{
+	  const data<Ty,Tx>& d=ds.get_data(i);
+	  if(!eval_model_derivative(m,pm,d.get_x(),p,dy))
 	    {
-	      if(y_obs<y_model)
-		{
-		  errx=errx1>0?errx1:-errx1;
-		}
-	      else
-		{
-		  errx=errx2>0?errx2:-errx2;
-		}
+	      return false;
 	    }
-	  else
+	  Ty y_model=m.eval(d.get_x(),p);
+	  Ty y_err=y_model>d.get_y()?d.get_y_upper_err():d.get_y_lower_err();
+	  for(size_t j=0;j<np;++j)
 	    {
-	      if(y_obs<y_model)
-		{
-		  errx=errx2>0?errx2:-errx2;
-		}
-	      else
-		{
-		  errx=errx1>0?errx1:-errx1;
-		}
+	      jac[i*np+j]=dy[j]/y_err;
 	    }
+	}
+      return true;
+#endif
+    }
 
-	  if(y_model>y_obs)
-	    {
-	      y_err=this->get_data_set().get_data(i).get_y_upper_err();
-	    }
-	  else
+  private:
+    //p reformed by the param_modifier, if any
+    bool within_limits(const model<Ty,Tx,Tp,Tstr>& m,const Tp& p)const
+    {
+      for(size_t i=0;i<p.size();++i)
+	{
+	  if(p[i]>m.get_param_info(i).get_upper_limit()||
+	     p[i]<m.get_param_info(i).get_lower_limit())
 	    {
-	      y_err=this->get_data_set().get_data(i).get_y_lower_err();
+	      return false;
 	    }
+	}
+      return true;
+    }
 
-	  Ty chi=(y_obs-y_model)/std::sqrt(y_err*y_err+errx*errx);
+    Ty residual(model<Ty,Tx,Tp,Tstr>& m,const data<Ty,Tx>& d,const Tp& p)const
+    {
+      Ty y_model=m.eval(d.get_x(),p);
+      Ty y_obs=d.get_y();
 
-	  result+=chi*chi;
+#ifdef HAVE_X_ERROR
+      Ty errx1=m.eval(d.get_x()-d.get_x_lower_err(),p)-y_model;
+      Ty errx2=m.eval(d.get_x()+d.get_x_upper_err(),p)-y_model;
+      Ty errx=0;
+      if((errx1<errx2)==(y_obs<y_model))
+	{
+	  errx=std::abs(errx1);
+	}
+      else
+	{
+	  errx=std::abs(errx2);
+	}
+#else
+      const Ty errx=0;
+#endif
 
-	  if(verb&&n%display_interval==0)
-	    {
-	      vx.at(i)=this->get_data_set().get_data(i).get_x();
-	      vy.at(i)=this->get_data_set().get_data(i).get_y();
-	      vye1.at(i)=std::abs(this->get_data_set().get_data(i).get_y_lower_err());
-	      vye2.at(i)=std::abs(this->get_data_set().get_data(i).get_y_upper_err());
-	      my.at(i)=y_model;
-
-	      xmin=std::min(vx.at(i),xmin);
-	      ymin=std::min(vy.at(i),ymin-vye1[i]);
-	      xmax=std::max(vx.at(i),xmax);
-	      ymax=std::max(vy.at(i),ymax+vye2[i]);
-	    }
+      Ty y_err=y_model>y_obs?d.get_y_upper_err():d.get_y_lower_err();
 
+      return (y_model-y_obs)/std::sqrt(y_err*y_err+errx*errx);
+    }
+
+    Ty chi2(model<Ty,Tx,Tp,Tstr>& m,const Tp& p)const
+    {
+      if(limit_bound&&!within_limits(m,m.reform_param(p)))
+	{
+	  return 1e99;
 	}
-      if(verb)
+      Ty result(0);
+      const data_set<Ty,Tx>& ds=this->get_data_set();
+      for(int i=ds.size()-1;i>=0;--i)
 	{
-	  if(n%display_interval==0)
-	    {
-	      cerr<<result<<"\t";
-	      for(size_t i=0;i<get_size(p);++i)
-		{
-		  cerr<<get_element(p,i)<<",";
-		}
-	      cerr<<endl;
-	      //cerr<<x1<<"\t"<<x2<<endl;
-	    }
+	  Ty chi=residual(m,ds.get_data(i),p);
+	  result+=chi*chi;
 	}
-
       return result;
     }
   };
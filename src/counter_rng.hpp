@@ -0,0 +1,90 @@
+#ifndef COUNTER_RNG_HPP
+#define COUNTER_RNG_HPP
+/*
+  Counter-based random numbers
+
+  Philox4x32-10 (Salmon et al. 2011, "Parallel random numbers: as easy
+  as 1, 2, 3"): a keyed bijection of 128-bit counters, whose outputs
+  pass BigCrush.  The random numbers are a pure function of the seed
+  and of the counter, with no state carried from one draw to the next,
+  so each of them can be drawn alone, in any order, on any thread.
+  The Monte Carlo replicas (see mc_profile.hpp) take the counter as
+  (replica, profile, bin, draw).
+*/
+
+#include <stdint.h>
+#include <cmath>
+
+namespace opt_utilities
+{
+  class counter_rng
+  {
+  private:
+    unsigned long long seed;
+    uint32_t key[2];
+
+    static void mulhilo(uint32_t a,uint32_t b,uint32_t& hi,uint32_t& lo)
+    {
+      const uint64_t p=uint64_t(a)*b;
+      hi=uint32_t(p>>32);
+      lo=uint32_t(p);
+    }
+
+    //uniform in (0,1), from 53 of the bits of w0 and w1
+    static double uniform(uint32_t w0,uint32_t w1)
+    {
+      const uint64_t z=(uint64_t(w0)<<32|w1)>>11;
+      return (double(z)+.5)*(1./double(1ULL<<53));
+    }
+
+  public:
+    explicit counter_rng(unsigned long long s=1)
+      :seed(s)
+    {
+      key[0]=uint32_t(s);
+      key[1]=uint32_t(s>>32);
+    }
+
+    unsigned long long get_seed()const
+    {
+      return seed;
+    }
+
+    //the 4 random words of the counter ctr
+    void generate(const uint32_t ctr[4],uint32_t out[4])const
+    {
+      uint32_t c[4]={ctr[0],ctr[1],ctr[2],ctr[3]};
+      uint32_t k0=key[0],k1=key[1];
+      for(int r=0;r<10;++r)
+        {
+          uint32_t hi0,lo0,hi1,lo1;
+          mulhilo(0xD2511F53u,c[0],hi0,lo0);
+          mulhilo(0xCD9E8D57u,c[2],hi1,lo1);
+          const uint32_t d[4]={hi1^c[1]^k0,lo1,hi0^c[3]^k1,lo0};
+          c[0]=d[0];
+          c[1]=d[1];
+          c[2]=d[2];
+          c[3]=d[3];
+          k0+=0x9E3779B9u;
+          k1+=0xBB67AE85u;
+        }
+      out[0]=c[0];
+      out[1]=c[1];
+      out[2]=c[2];
+      out[3]=c[3];
+    }
+
+    //a standard normal deviate of the counter (c0,c1,c2,c3), by the
+    //Box-Muller transform of its two uniforms
+    double normal(uint32_t c0,uint32_t c1,uint32_t c2,uint32_t c3)const
+    {
+      static const double two_pi=8*std::atan(1.);
+      const uint32_t ctr[4]={c0,c1,c2,c3};
+      uint32_t w[4];
+      generate(ctr,w);
+      return std::sqrt(-2*std::log(uniform(w[0],w[1])))*std::cos(two_pi*uniform(w[2],w[3]));
+    }
+  };
+}
+
+#endif
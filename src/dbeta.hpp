@@ -12,7 +12,9 @@ namespace opt_utilities
 {
   template <typename T>
   class dbeta
-    :public model<std::vector<T>,std::vector<T>,std::vector<T> >
+    :public model<std::vector<T>,std::vector<T>,std::vector<T> >,
+     public fused_model<std::vector<T>,std::vector<T>,std::vector<T> >,
+     public param_derivative<std::vector<T>,std::vector<T>,std::vector<T> >
   {
   public:
     dbeta()
@@ -36,17 +38,28 @@ namespace opt_utilities
     std::vector<T> do_eval(const std::vector<T> & x,
 			   const std::vector<T>& p)
     {
-      T n01=std::abs(p[0]);
+      std::vector<T> result;
+      do_eval_into(x,p,result);
+      return result;
+    }
+
+    void do_eval_into(const std::vector<T> & x,
+		      const std::vector<T>& p,
+		      std::vector<T>& result)
+    {
+      using std::abs;
+      using std::pow;
+      T n01=abs(p[0]);
       T beta1=p[1];
       T rc1=p[2];
 
-      T n02=std::abs(p[3]);
+      T n02=abs(p[3]);
       T beta2=p[4];
       T rc2=p[5];
 
 
 
-      std::vector<T> result(x.size()-1);
+      result.resize(x.size()-1);
       for(size_t i=1;i<x.size();++i)
 	{
 	  T xi=(x[i]+x[i-1])/2;
@@ -54,13 +67,53 @@ namespace opt_utilities
 	  yi=n01*pow(1+xi*xi/rc1/rc1,-3./2.*beta1)+n02*pow(1+xi*xi/rc2/rc2,-3./2.*beta2);
 	  result[i-1]=yi;
 	}
-      return result;
+    }
+
+    bool do_eval_derivative(const std::vector<T>& x,
+			    const std::vector<T>& p,
+			    std::vector<std::vector<T> >& dy)
+    {
+      using std::abs;
+      using std::pow;
+      using std::log;
+      T n01=abs(p[0]);
+      T beta1=p[1];
+      T rc1=p[2];
+      T sn01=p[0]<0?-1:1;
+
+      T n02=abs(p[3]);
+      T beta2=p[4];
+      T rc2=p[5];
+      T sn02=p[3]<0?-1:1;
+
+      dy.resize(6);
+      for(size_t j=0;j<6;++j)
+	{
+	  dy[j].resize(x.size()-1);
+	}
+      for(size_t i=1;i<x.size();++i)
+	{
+	  T xi=(x[i]+x[i-1])/2;
+	  T u1=1+xi*xi/rc1/rc1;
+	  T f1=pow(u1,-3./2.*beta1);
+	  T u2=1+xi*xi/rc2/rc2;
+	  T f2=pow(u2,-3./2.*beta2);
+	  dy[0][i-1]=sn01*f1;
+	  dy[1][i-1]=-3./2.*log(u1)*n01*f1;
+	  dy[2][i-1]=3*beta1*xi*xi/(rc1*rc1*rc1)*n01*f1/u1;
+	  dy[3][i-1]=sn02*f2;
+	  dy[4][i-1]=-3./2.*log(u2)*n02*f2;
+	  dy[5][i-1]=3*beta2*xi*xi/(rc2*rc2*rc2)*n02*f2/u2;
+	}
+      return true;
     }
   };
 
   template <typename T>
   class dbeta2
-    :public model<std::vector<T>,std::vector<T>,std::vector<T> >
+    :public model<std::vector<T>,std::vector<T>,std::vector<T> >,
+     public fused_model<std::vector<T>,std::vector<T>,std::vector<T> >,
+     public param_derivative<std::vector<T>,std::vector<T>,std::vector<T> >
   {
   public:
     dbeta2()
@@ -82,16 +135,27 @@ namespace opt_utilities
     std::vector<T> do_eval(const std::vector<T> & x,
 			   const std::vector<T>& p)
     {
-      T n01=std::abs(p[0]);
+      std::vector<T> result;
+      do_eval_into(x,p,result);
+      return result;
+    }
+
+    void do_eval_into(const std::vector<T> & x,
+		      const std::vector<T>& p,
+		      std::vector<T>& result)
+    {
+      using std::abs;
+      using std::pow;
+      T n01=abs(p[0]);
       T rc1=p[1];
 
-      T n02=std::abs(p[2]);
+      T n02=abs(p[2]);
       T rc2=p[3];
       T beta=p[4];
       T beta1=beta;
       T beta2=beta;
 
-      std::vector<T> result(x.size()-1);
+      result.resize(x.size()-1);
       for(size_t i=1;i<x.size();++i)
 	{
 	  T xi=(x[i]+x[i-1])/2;
@@ -99,7 +163,44 @@ namespace opt_utilities
 	  yi=n01*pow(1+xi*xi/rc1/rc1,-3./2.*beta1)+n02*pow(1+xi*xi/rc2/rc2,-3./2.*beta2);
 	  result[i-1]=yi;
 	}
-      return result;
+    }
+
+    bool do_eval_derivative(const std::vector<T>& x,
+			    const std::vector<T>& p,
+			    std::vector<std::vector<T> >& dy)
+    {
+      using std::abs;
+      using std::pow;
+      using std::log;
+      T n01=abs(p[0]);
+      T rc1=p[1];
+      T sn01=p[0]<0?-1:1;
+
+      T n02=abs(p[2]);
+      T rc2=p[3];
+      T sn02=p[2]<0?-1:1;
+      T beta=p[4];
+
+      dy.resize(5);
+      for(size_t j=0;j<5;++j)
+	{
+	  dy[j].resize(x.size()-1);
+	}
+      for(size_t i=1;i<x.size();++i)
+	{
+	  T xi=(x[i]+x[i-1])/2;
+	  T u1=1+xi*xi/rc1/rc1;
+	  T f1=pow(u1,-3./2.*beta);
+	  T u2=1+xi*xi/rc2/rc2;
+	  T f2=pow(u2,-3./2.*beta);
+	  dy[0][i-1]=sn01*f1;
+	  dy[1][i-1]=3*beta*xi*xi/(rc1*rc1*rc1)*n01*f1/u1;
+	  dy[2][i-1]=sn02*f2;
+	  dy[3][i-1]=3*beta*xi*xi/(rc2*rc2*rc2)*n02*f2/u2;
+	  //the beta is shared by both components
+	  dy[4][i-1]=-3./2.*(log(u1)*n01*f1+log(u2)*n02*f2);
+	}
+      return true;
     }
   };
 
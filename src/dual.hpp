@@ -0,0 +1,291 @@
+#ifndef DUAL_HPP
+#define DUAL_HPP
+/*
+  Dual numbers for the forward mode automatic differentiation
+
+  dual<T,N> carries a value and N tangents, so that a model template
+  instantiated on it (e.g., beta<dual<double,3> >) gives the derivatives
+  with respect to N seeded parameters in one evaluation.  The overloads
+  of abs, pow, log, sqrt, exp and atan are found by ADL, so the model
+  templates call them unqualified after using std::abs etc.  Comparisons
+  only look at the values; identical() also looks at the tangents, for
+  the caches keyed on the parameters.
+*/
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace opt_utilities
+{
+  //x and y are the same, e.g., as the key of a cache
+  template <typename T>
+  inline bool identical(const T& x,const T& y)
+  {
+    return x==y;
+  }
+
+  template <typename T>
+  inline bool identical(const std::vector<T>& x,const std::vector<T>& y)
+  {
+    if(x.size()!=y.size())
+      {
+        return false;
+      }
+    for(size_t i=0;i<x.size();++i)
+      {
+        if(!identical(x[i],y[i]))
+          {
+            return false;
+          }
+      }
+    return true;
+  }
+
+  //the operations live in a namespace of their own, so that they are
+  //found by ADL without hiding ::pow etc. inside opt_utilities
+  namespace ad
+  {
+    template <typename T,size_t N>
+    class dual
+    {
+    public:
+      typedef T value_type;
+    private:
+      T v;
+      T d[N];
+
+    public:
+      //a constant
+      dual(const T& x=T(0))
+        :v(x)
+      {
+        for(size_t i=0;i<N;++i)
+          {
+            d[i]=T(0);
+          }
+      }
+
+      //a variable, with the k-th tangent seeded
+      dual(const T& x,size_t k)
+        :v(x)
+      {
+        for(size_t i=0;i<N;++i)
+          {
+            d[i]=T(i==k?1:0);
+          }
+      }
+
+      const T& value()const
+      {
+        return v;
+      }
+
+      const T& tangent(size_t i)const
+      {
+        return d[i];
+      }
+
+      T& tangent(size_t i)
+      {
+        return d[i];
+      }
+
+      //f(v), with the tangents scaled by f'(v)
+      dual chain(const T& fv,const T& dfv)const
+      {
+        dual r(fv);
+        for(size_t i=0;i<N;++i)
+          {
+            r.d[i]=dfv*d[i];
+          }
+        return r;
+      }
+
+      dual& operator+=(const dual& y)
+      {
+        v+=y.v;
+        for(size_t i=0;i<N;++i)
+          {
+            d[i]+=y.d[i];
+          }
+        return *this;
+      }
+
+      dual& operator-=(const dual& y)
+      {
+        v-=y.v;
+        for(size_t i=0;i<N;++i)
+          {
+            d[i]-=y.d[i];
+          }
+        return *this;
+      }
+
+      dual& operator*=(const dual& y)
+      {
+        for(size_t i=0;i<N;++i)
+          {
+            d[i]=d[i]*y.v+v*y.d[i];
+          }
+        v*=y.v;
+        return *this;
+      }
+
+      dual& operator/=(const dual& y)
+      {
+        const T inv=T(1)/y.v;
+        v*=inv;
+        for(size_t i=0;i<N;++i)
+          {
+            d[i]=(d[i]-v*y.d[i])*inv;
+          }
+        return *this;
+      }
+
+      dual operator-()const
+      {
+        return chain(-v,T(-1));
+      }
+
+      dual operator+()const
+      {
+        return *this;
+      }
+
+      //non-template friends, so that the scalars on either side are
+      //converted, e.g., 1+x*x
+      friend dual operator+(dual x,const dual& y)
+      {
+        return x+=y;
+      }
+
+      friend dual operator-(dual x,const dual& y)
+      {
+        return x-=y;
+      }
+
+      friend dual operator*(dual x,const dual& y)
+      {
+        return x*=y;
+      }
+
+      friend dual operator/(dual x,const dual& y)
+      {
+        return x/=y;
+      }
+
+      friend bool operator<(const dual& x,const dual& y)
+      {
+        return x.v<y.v;
+      }
+
+      friend bool operator>(const dual& x,const dual& y)
+      {
+        return x.v>y.v;
+      }
+
+      friend bool operator<=(const dual& x,const dual& y)
+      {
+        return x.v<=y.v;
+      }
+
+      friend bool operator>=(const dual& x,const dual& y)
+      {
+        return x.v>=y.v;
+      }
+
+      friend bool operator==(const dual& x,const dual& y)
+      {
+        return x.v==y.v;
+      }
+
+      friend bool operator!=(const dual& x,const dual& y)
+      {
+        return x.v!=y.v;
+      }
+    };
+
+    //the values and the tangents are the same
+    template <typename T,size_t N>
+    inline bool identical(const dual<T,N>& x,const dual<T,N>& y)
+    {
+      if(x.value()!=y.value())
+        {
+          return false;
+        }
+      for(size_t i=0;i<N;++i)
+        {
+          if(x.tangent(i)!=y.tangent(i))
+            {
+              return false;
+            }
+        }
+      return true;
+    }
+
+    template <typename T,size_t N>
+    inline dual<T,N> abs(const dual<T,N>& x)
+    {
+      return x.value()<0?-x:x;
+    }
+
+    template <typename T,size_t N>
+    inline dual<T,N> sqrt(const dual<T,N>& x)
+    {
+      const T s=std::sqrt(x.value());
+      return x.chain(s,T(1)/(2*s));
+    }
+
+    template <typename T,size_t N>
+    inline dual<T,N> log(const dual<T,N>& x)
+    {
+      return x.chain(std::log(x.value()),T(1)/x.value());
+    }
+
+    template <typename T,size_t N>
+    inline dual<T,N> exp(const dual<T,N>& x)
+    {
+      const T e=std::exp(x.value());
+      return x.chain(e,e);
+    }
+
+    template <typename T,size_t N>
+    inline dual<T,N> atan(const dual<T,N>& x)
+    {
+      return x.chain(std::atan(x.value()),T(1)/(1+x.value()*x.value()));
+    }
+
+    template <typename T,size_t N>
+    inline dual<T,N> pow(const dual<T,N>& x,const typename dual<T,N>::value_type& y)
+    {
+      return x.chain(std::pow(x.value(),y),y*std::pow(x.value(),y-1));
+    }
+
+    template <typename T,size_t N>
+    inline dual<T,N> pow(const typename dual<T,N>::value_type& x,const dual<T,N>& y)
+    {
+      const T p=std::pow(x,y.value());
+      //d(x^y)/dy=x^y*log(x), taken as 0 at x=0
+      return y.chain(p,x>0?p*std::log(x):T(0));
+    }
+
+    template <typename T,size_t N>
+    inline dual<T,N> pow(const dual<T,N>& x,const dual<T,N>& y)
+    {
+      const T p=std::pow(x.value(),y.value());
+      dual<T,N> r(p);
+      const T dx=y.value()*std::pow(x.value(),y.value()-1);
+      const T dy=x.value()>0?p*std::log(x.value()):T(0);
+      for(size_t i=0;i<N;++i)
+        {
+          r.tangent(i)=dx*x.tangent(i)+dy*y.tangent(i);
+        }
+      return r;
+    }
+  }
+
+  using ad::dual;
+}
+
+#endif
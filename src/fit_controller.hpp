@@ -0,0 +1,327 @@
+#ifndef FIT_CONTROLLER_HPP
+#define FIT_CONTROLLER_HPP
+/*
+  Fit controller
+
+  Repeats fitter::fit() while the statistic improves by more than a
+  relative tolerance, up to max_fits times, within a budget of statistic
+  evaluations and of wall-clock time (0 for no limit).  The budgets are
+  enforced by metered_statistic, which wraps the statistic of the fitter
+  for the duration of fit(): once over budget, it aborts the running
+  optimization, and the fitter is left at the best parameters seen.
+  get_stop_reason() tells why the controller stopped.
+  The default budgets can be set at compile time with FIT_MAX_EVALS and
+  FIT_MAX_SECONDS, e.g., for the Monte Carlo runs of the tools.
+*/
+
+#include <core/fitter.hpp>
+#include "residual_func.hpp"
+#include <vector>
+#include <string>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <sys/time.h>
+
+//default budgets of fit_controller, 0 for no limit
+#ifndef FIT_MAX_EVALS
+#define FIT_MAX_EVALS 0
+#endif
+
+#ifndef FIT_MAX_SECONDS
+#define FIT_MAX_SECONDS 0
+#endif
+
+namespace opt_utilities
+{
+  //thrown by metered_statistic to abort an optimization over budget
+  class fit_budget_exceeded
+    :public opt_exception
+  {
+  public:
+    fit_budget_exceeded(const std::string& m="")
+      :opt_exception(m)
+    {}
+  };
+
+  //wall-clock time in seconds
+  inline double wall_time()
+  {
+    timeval tv;
+    gettimeofday(&tv,0);
+    return tv.tv_sec+tv.tv_usec*1e-6;
+  }
+
+  //A statistic wrapper that counts the evaluations, keeps the best
+  //parameters seen, and throws fit_budget_exceeded once the budget is
+  //spent; residual_func is passed on if the wrapped statistic has it
+  template <typename Ty,typename Tx,typename Tp,typename Ts,typename Tstr=std::string>
+  class metered_statistic
+    :public statistic<Ty,Tx,Tp,Ts,Tstr>,
+     public residual_func<Ts>
+  {
+  private:
+    statistic<Ty,Tx,Tp,Ts,Tstr>* pstat;
+    size_t max_evals;
+    double deadline;
+    size_t num_evals;
+    bool over_time;
+    Ts best_stat;
+    Tp best_p;
+
+  public:
+    metered_statistic(const statistic<Ty,Tx,Tp,Ts,Tstr>& s,size_t max_n,double dl)
+      :pstat(s.clone()),max_evals(max_n),deadline(dl),num_evals(0),over_time(false),
+       best_stat(std::numeric_limits<Ts>::max())
+    {}
+
+    metered_statistic(const metered_statistic& rhs)
+      :statistic<Ty,Tx,Tp,Ts,Tstr>(rhs),residual_func<Ts>(rhs),pstat(rhs.pstat->clone()),
+       max_evals(rhs.max_evals),deadline(rhs.deadline),num_evals(rhs.num_evals),
+       over_time(rhs.over_time),best_stat(rhs.best_stat),best_p(rhs.best_p)
+    {}
+
+    ~metered_statistic()
+    {
+      pstat->destroy();
+    }
+
+    size_t get_num_evals()const
+    {
+      return num_evals;
+    }
+
+    //true if the budget was spent on the time limit
+    bool is_over_time()const
+    {
+      return over_time;
+    }
+
+    //the best (free) parameters seen, empty if none
+    const Tp& get_best_params()const
+    {
+      return best_p;
+    }
+
+    Ts get_best_statistic()const
+    {
+      return best_stat;
+    }
+
+  private:
+    metered_statistic& operator=(const metered_statistic&);
+
+    statistic<Ty,Tx,Tp,Ts,Tstr>* do_clone()const
+    {
+      return new metered_statistic(*this);
+    }
+
+    const char* do_get_type_name()const
+    {
+      return pstat->get_type_name();
+    }
+
+    //count an evaluation, throwing if the budget is spent
+    void charge()
+    {
+      if(max_evals>0&&num_evals>=max_evals)
+        {
+          throw fit_budget_exceeded("statistic evaluation budget spent");
+        }
+      if(deadline>0&&wall_time()>deadline)
+        {
+          over_time=true;
+          throw fit_budget_exceeded("wall-clock limit reached");
+        }
+      ++num_evals;
+      pstat->set_fitter(*this->p_fitter);
+    }
+
+    void record(const Tp& p,Ts s)
+    {
+      if(s<best_stat)
+        {
+          best_stat=s;
+          best_p=p;
+        }
+    }
+
+    Ts do_eval(const Tp& p)
+    {
+      charge();
+      const Ts s=pstat->eval(p);
+      record(p,s);
+      return s;
+    }
+
+  public:
+    bool eval_residuals(const Tp& p,std::vector<Ts>& r)
+    {
+      residual_func<Ts>* prf=dynamic_cast<residual_func<Ts>*>(pstat);
+      if(!prf)
+        {
+          throw opt_exception("the statistic has no residuals");
+        }
+      charge();
+      if(!prf->eval_residuals(p,r))
+        {
+          return false;
+        }
+      Ts s=0;
+      for(size_t i=0;i<r.size();++i)
+        {
+          s+=r[i]*r[i];
+        }
+      record(p,s);
+      return true;
+    }
+
+    bool eval_jacobian(const Tp& p,std::vector<Ts>& jac)
+    {
+      residual_func<Ts>* prf=dynamic_cast<residual_func<Ts>*>(pstat);
+      if(!prf)
+        {
+          return false;
+        }
+      charge();
+      return prf->eval_jacobian(p,jac);
+    }
+  };
+
+  template <typename Ty,typename Tx,typename Tp,typename Ts,typename Tstr=std::string>
+  class fit_controller
+  {
+  public:
+    enum stop_reason
+      {
+        not_run,
+        converged,
+        max_fits_reached,
+        eval_budget_spent,
+        time_limit_reached
+      };
+  private:
+    Ts tolerance;
+    size_t max_fits;
+    size_t max_evals;
+    double max_seconds;
+    stop_reason reason;
+    size_t num_fits;
+    size_t num_evals;
+
+  public:
+    fit_controller()
+      :tolerance(1e-4),max_fits(100),max_evals(FIT_MAX_EVALS),max_seconds(FIT_MAX_SECONDS),
+       reason(not_run),num_fits(0),num_evals(0)
+    {}
+
+    //relative improvement of the statistic below which the fits stop
+    void set_tolerance(Ts t)
+    {
+      tolerance=t;
+    }
+
+    void set_max_fits(size_t n)
+    {
+      max_fits=std::max(n,size_t(1));
+    }
+
+    //maximum number of statistic evaluations of fit(), 0 for no limit
+    void set_max_evals(size_t n)
+    {
+      max_evals=n;
+    }
+
+    //wall-clock limit of fit() in seconds, 0 for no limit
+    void set_max_seconds(double t)
+    {
+      max_seconds=t;
+    }
+
+    stop_reason get_stop_reason()const
+    {
+      return reason;
+    }
+
+    const char* get_stop_reason_name()const
+    {
+      switch(reason)
+        {
+        case converged:
+          return "converged";
+        case max_fits_reached:
+          return "maximum number of fits reached";
+        case eval_budget_spent:
+          return "evaluation budget spent";
+        case time_limit_reached:
+          return "wall-clock limit reached";
+        default:
+          return "not run";
+        }
+    }
+
+    //number of fit() calls, and of statistic evaluations, of the last fit()
+    size_t get_num_fits()const
+    {
+      return num_fits;
+    }
+
+    size_t get_num_evals()const
+    {
+      return num_evals;
+    }
+
+    //fit f until it converges or a budget is spent, and return its
+    //(full) parameters; f keeps its own statistic
+    Tp fit(fitter<Ty,Tx,Tp,Ts,Tstr>& f)
+    {
+      typedef metered_statistic<Ty,Tx,Tp,Ts,Tstr> metered;
+      statistic<Ty,Tx,Tp,Ts,Tstr>* orig=f.get_statistic().clone();
+      f.set_statistic(metered(*orig,max_evals,max_seconds>0?wall_time()+max_seconds:0));
+      metered& ms=dynamic_cast<metered&>(f.get_statistic());
+      num_fits=0;
+      reason=max_fits_reached;
+      try
+        {
+          Ts prev=f.get_statistic_value();
+          while(num_fits<max_fits)
+            {
+              f.fit();
+              ++num_fits;
+              const Ts s=f.get_statistic_value();
+              if(!(prev-s>tolerance*std::abs(s)))
+                {
+                  reason=converged;
+                  break;
+                }
+              prev=s;
+            }
+        }
+      catch(const fit_budget_exceeded&)
+        {
+          reason=ms.is_over_time()?time_limit_reached:eval_budget_spent;
+          //the fitter is left at the best parameters seen
+          if(!ms.get_best_params().empty())
+            {
+              const Tp full=f.get_model().reform_param(ms.get_best_params());
+              for(size_t i=0;i<full.size();++i)
+                {
+                  f.set_param_value(f.get_param_info(i).get_name(),full[i]);
+                }
+            }
+        }
+      catch(...)
+        {
+          f.set_statistic(*orig);
+          orig->destroy();
+          throw;
+        }
+      num_evals=ms.get_num_evals();
+      f.set_statistic(*orig);
+      orig->destroy();
+      return f.get_all_params();
+    }
+  };
+}
+
+#endif
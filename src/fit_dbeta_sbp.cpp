@@ -17,7 +17,11 @@
 #include <methods/powell/powell_method.hpp>
 #include <core/freeze_param.hpp>
 #include <error_estimator/error_estimator.hpp>
-#include "spline.hpp"
+#include "spline_func_obj.hpp"
+#include "parallel.hpp"
+#include "lm_method.hpp"
+#include "fit_schedule.hpp"
+#include "varpro.hpp"
 
 using namespace std;
 using namespace opt_utilities;
@@ -45,39 +49,6 @@ static double calc_critical_density(double z,
 }
 
 
-//A class enclosing the spline interpolation method
-class spline_func_obj
-  :public func_obj<double,double>
-{
-  //has an spline object
-  spline<double> spl;
-public:
-  //This function is used to calculate the intepolated value
-  double do_eval(const double& x)
-  {
-    return spl.get_value(x);
-  }
-
-  //we need this function, when this object is performing a clone of itself
-  spline_func_obj* do_clone()const
-  {
-    return new spline_func_obj(*this);
-  }
-
-public:
-  //add points to the spline object, after which the spline will be initialized
-  void add_point(double x,double y)
-  {
-    spl.push_point(x,y);
-  }
-
-  //before getting the intepolated value, the spline should be initialzied by calling this function
-  void gen_spline()
-  {
-    spl.gen_spline(0,0);
-  }
-};
-
 int main(int argc,char* argv[])
 {
   if(argc!=2)
@@ -90,6 +61,11 @@ int main(int argc,char* argv[])
   assert(cfg_file.is_open());
   cfg_map cfg=parse_cfg_file(cfg_file);
 
+  if(cfg.omp_min_bins>0)
+    {
+      set_omp_min_bins(cfg.omp_min_bins);
+    }
+
   const double z=cfg.z;
 
   //initialize the radius list, sbp list and sbp error list
@@ -259,13 +235,36 @@ int main(int argc,char* argv[])
   a.set_cm_per_pixel(cm_per_pixel);
 
   f.set_model(a);
-  //chi^2 statistic
+  //chi^2 statistic, or with bkg solved by the linear least squares for
+  //each of the other parameters (see varpro.hpp); n01 and n02 are not
+  //linear amplitudes, as the emission goes with the square of their sum
   vchisq<double> c;
   c.verbose(true);
   c.set_limit();
-  f.set_statistic(c);
+  varpro_chisq<double> vc;
+  vc.set_offset_param("bkg");
+  vc.verbose(true);
+  vc.set_limit();
+  const bool varpro=cfg.fit_mode=="varpro";
+  if(!varpro&&cfg.fit_mode!="normal")
+    {
+      cerr<<"unknown fit_mode: "<<cfg.fit_mode<<endl;
+      return -1;
+    }
+  if(varpro)
+    {
+      f.set_statistic(vc);
+    }
+  else
+    {
+      f.set_statistic(c);
+    }
   //optimization method
-  f.set_opt_method(powell_method<double,std::vector<double> >());
+  if(!set_opt_method_by_name(f,cfg.opt_method))
+    {
+      cerr<<"unknown opt_method: "<<cfg.opt_method<<endl;
+      return -1;
+    }
   //initialize the initial values
   double n01=0;
   double rc1=0;
@@ -314,35 +313,61 @@ int main(int argc,char* argv[])
 
 
 
-  //perform the fitting, first freeze beta1, beta2, rc1, and rc2
-  if(tie_beta)
+  //perform the fitting by the fit_stage schedule of the config, by
+  //default first with beta and rc frozen, then with all parameters
+  //thawed from several starting points in parallel, each refitted twice
+  fit_schedule<std::vector<double>,std::vector<double>,std::vector<double>,double,std::string> sched;
+  for(size_t i=0;i<cfg.fit_stages.size();++i)
     {
-      f.set_param_modifier(freeze_param<std::vector<double>,std::vector<double>,std::vector<double>,std::string>("beta")+
-			   freeze_param<std::vector<double>,std::vector<double>,std::vector<double>,std::string>("rc1")+
-			   freeze_param<std::vector<double>,std::vector<double>,std::vector<double>,std::string>("rc2")
-			   );
+      fit_stage s;
+      if(!parse_fit_stage(cfg.fit_stages[i],s))
+	{
+	  cerr<<"invalid fit_stage: "<<cfg.fit_stages[i]<<endl;
+	  return -1;
+	}
+      sched.add_stage(s);
     }
-  else
+  if(sched.get_num_stages()==0)
     {
-      f.set_param_modifier(freeze_param<std::vector<double>,std::vector<double>,std::vector<double>,std::string>("beta1")+
-			   freeze_param<std::vector<double>,std::vector<double>,std::vector<double>,std::string>("beta2")+
-			   freeze_param<std::vector<double>,std::vector<double>,std::vector<double>,std::string>("rc1")+
-			   freeze_param<std::vector<double>,std::vector<double>,std::vector<double>,std::string>("rc2")
-			   );
+      fit_stage s1(cfg.opt_method);
+      if(tie_beta)
+	{
+	  s1.frozen.push_back("beta");
+	}
+      else
+	{
+	  s1.frozen.push_back("beta1");
+	  s1.frozen.push_back("beta2");
+	}
+      s1.frozen.push_back("rc1");
+      s1.frozen.push_back("rc2");
+      sched.add_stage(s1);
+      fit_stage s2(cfg.opt_method);
+      s2.max_fits=2;
+      s2.num_starts=cfg.num_starts;
+      sched.add_stage(s2);
+    }
+  if(cfg.fit_max_evals>0)
+    {
+      sched.set_max_evals(cfg.fit_max_evals);
+    }
+  if(cfg.fit_max_seconds>0)
+    {
+      sched.set_max_seconds(cfg.fit_max_seconds);
+    }
+  if(varpro)
+    {
+      sched.add_held_param("bkg");
+    }
+  sched.verbose(true);
+  sched.run(f);
+  if(varpro)
+    {
+      //set bkg to its solution, and go back to the plain chi^2
+      dynamic_cast<varpro_chisq<double>&>(f.get_statistic()).solve_amplitudes();
+      f.clear_param_modifier();
+      f.set_statistic(c);
     }
-
-  f.fit();
-
-  f.clear_param_modifier();
-
-  //then perform the fitting, freeze beta1 and beta2
-  //f.set_param_modifier(freeze_param<std::vector<double>,std::vector<double>,std::vector<double>,std::string>("beta"));
-  //f.set_param_modifier(freeze_param<std::vector<double>,std::vector<double>,std::vector<double>,std::string>("bkg"));
-  f.fit();
-  //f.clear_param_modifier();
-
-  //finally thaw all parameters
-  f.fit();
   double beta1=0;
   double beta2=0;
 
@@ -381,6 +406,11 @@ int main(int argc,char* argv[])
     }
   cerr<<"reduced_chi^2="<<f.get_statistic_value()/(radii.size()-f.get_model().get_num_free_params())<<endl;
   param_output<<"reduced_chi^2="<<f.get_statistic_value()/(radii.size()-f.get_model().get_num_free_params())<<endl;
+  projector<double>& pj=dynamic_cast<projector<double>&>(f.get_model());
+  cerr<<"projector volume cache: "<<pj.get_cache_hits()<<" hits, "
+      <<pj.get_cache_rebuilds()<<" rebuilds"<<endl;
+  cerr<<"projector source cache: "<<pj.get_source_cache_hits()
+      <<" evaluations with only bkg changed"<<endl;
 
   //c.verbose(false);
   //f.set_statistic(c);
@@ -522,10 +552,34 @@ int main(int argc,char* argv[])
   //ofs_mass<<"la y mass enclosed (solar mass)"<<endl;
   //ofs_overdensity<<"la x radius (kpc)"<<endl;
   //ofs_overdensity<<"la y overdensity"<<endl;
-  double gas_mass=0;
+  //integration grid, with dr=r/100
+  std::vector<double> rlist;
   for(double r=1;r<200000;r+=dr)
     {
       dr=r/100;
+      rlist.push_back(r);
+    }
+
+  //the temperatures at r and r+dr, evaluated in one sweep each
+  const int nr=rlist.size();
+  std::vector<double> r1list(nr),T_list(nr),T1_list(nr);
+  for(int i=0;i<nr;++i)
+    {
+      r1list[i]=rlist[i]+rlist[i]/100;
+    }
+  Tprof.eval_batch(&rlist[0],&T_list[0],nr);
+  Tprof.eval_batch(&r1list[0],&T1_list[0],nr);
+
+  //the local quantities are independent of each other
+  std::vector<double> ne_list(nr),dmgas_list(nr),M_list(nr),rho_list(nr),S_list(nr);
+  std::vector<double> ne_beta1_list(nr),ne_beta2_list(nr);
+#ifdef _OPENMP
+#pragma omp parallel for if(nr>=(int)omp_min_bins())
+#endif
+  for(int i=0;i<nr;++i)
+    {
+      double r=rlist[i];
+      double dr=r/100;
       double r1=r+dr;
       double r_cm=r*cm_per_pixel;
       double r1_cm=r1*cm_per_pixel;
@@ -533,19 +587,14 @@ int main(int argc,char* argv[])
       double V_cm3=4./3.*pi*(dr_cm*(r1_cm*r1_cm+r_cm*r_cm+r_cm*r1_cm));
       double ne=dbeta_func(r,n01,rc1,beta1,
 			   n02,rc2,beta2);//cm^3
-
-      double dmgas=V_cm3*ne*mu*mp/M_sun;
-      gas_mass+=dmgas;
-
-      ofs_gas_mass<<r*cm_per_pixel/kpc<<"\t"<<gas_mass<<endl;
       double ne_beta1=dbeta_func(r,n01,rc1,beta1, 0,rc2,beta2);
 
       double ne_beta2=dbeta_func(r,0,rc1,beta1, n02,rc2,beta2);
 
       double ne1=dbeta_func(r1,n01,rc1,beta1, n02,rc2,beta2);//cm^3
 
-      double T_keV=Tprof(r);
-      double T1_keV=Tprof(r1);
+      double T_keV=T_list[i];
+      double T1_keV=T1_list[i];
 
       //double T_K=T_keV*11604505.9;
       //double T1_K=T1_keV*11604505.9;
@@ -566,9 +615,28 @@ int main(int argc,char* argv[])
       //cout<<r<<"\t"<<M/M_sun<<endl;
       //cout<<r<<"\t"<<T_keV<<endl;
 
-      ofs_rho<<r*cm_per_pixel/kpc<<"\t"<<ne<<"\t"<<ne_beta1<<"\t"<<ne_beta2<<endl;
+      ne_list[i]=ne;
+      ne_beta1_list[i]=ne_beta1;
+      ne_beta2_list[i]=ne_beta2;
+      dmgas_list[i]=V_cm3*ne*mu*mp/M_sun;
+      M_list[i]=M;
+      rho_list[i]=rho;
+      S_list[i]=S;
+    }
+
+  //the gas mass is accumulated, and the results are written, in order
+  double gas_mass=0;
+  for(int i=0;i<nr;++i)
+    {
+      double r=rlist[i];
+      double ne=ne_list[i];
+      double M=M_list[i];
+      gas_mass+=dmgas_list[i];
+
+      ofs_gas_mass<<r*cm_per_pixel/kpc<<"\t"<<gas_mass<<endl;
+      ofs_rho<<r*cm_per_pixel/kpc<<"\t"<<ne<<"\t"<<ne_beta1_list[i]<<"\t"<<ne_beta2_list[i]<<endl;
       ofs_rho_data<<r*cm_per_pixel/kpc<<"\t"<<ne<<endl;
-      ofs_entropy<<r*cm_per_pixel/kpc<<"\t"<<S<<endl;
+      ofs_entropy<<r*cm_per_pixel/kpc<<"\t"<<S_list[i]<<endl;
 #if 0
       if(r*cm_per_pixel/kpc<5)
 	{
@@ -580,7 +648,7 @@ int main(int argc,char* argv[])
 	{
 	  ofs_mass_dat<<r*cm_per_pixel/kpc<<"\t0\t"<<M/M_sun<<"\t"<<M/M_sun*.1<<endl;
 	}
-      ofs_overdensity<<r*cm_per_pixel/kpc<<"\t"<<rho/calc_critical_density(z)<<endl;
+      ofs_overdensity<<r*cm_per_pixel/kpc<<"\t"<<rho_list[i]/calc_critical_density(z)<<endl;
 
     }
 }
@@ -0,0 +1,851 @@
+/*
+  Monte Carlo errors of the mass profile, in one process
+
+  Runs the Monte Carlo loop of bin/fit_mass.sh on the data loaded once:
+  each replica shuffles the temperature and surface brightness profiles,
+  fits the temperature profile, interpolates the cooling function table
+  on it, fits the single- or double-beta model to the SBP, derives the
+  hydrostatic mass, gas mass and entropy profiles, and fits the NFW
+  model to the mass profile.  The replicas run in parallel (make
+  OPENMP=1), and are appended to the summary_*.qdp files of the script
+  in their order, each followed by "no no no".  A replica whose fits
+  fail is reported and left out.  The random numbers of a replica
+  depend only on the seed, recorded in the summary files, and on its
+  number, so the summaries do not depend on the number of threads, and
+  a replica can be run again alone (e.g., replicas "42-42").
+  The replicas are also summarized as they are written (see
+  mc_aggregate.hpp): the mean, standard deviation and P-square quantiles
+  at each radius of the profiles, in memory that does not grow with the
+  number of replicas, go to summary_*_stat.qdp, and r, M, gas mass and
+  gas fraction at the overdensities of the script, kept for each
+  replica, with their errors around the center profiles (*_center.qdp
+  of the script, or else fitted here) by the exact order statistics of
+  analyze_mass_profile.py, to summary_delta.txt.
+  Based on fit_wang2012_model, fit_beta_sbp, fit_dbeta_sbp and
+  fit_nfw_mass.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <iomanip>
+#include "beta_cfg.hpp"
+#include "mc_profile.hpp"
+#include "mc_aggregate.hpp"
+#include "vchisq.hpp"
+#include "beta.hpp"
+#include "dbeta.hpp"
+#include "nfw.hpp"
+#include <data_sets/default_data_set.hpp>
+#include <methods/powell/powell_method.hpp>
+#include "spline_func_obj.hpp"
+#include "parallel.hpp"
+#include "lm_method.hpp"
+#include "fit_schedule.hpp"
+#include "varpro.hpp"
+
+using namespace std;
+using namespace opt_utilities;
+const double kpc=3.086E21;//kpc in cm
+const double Mpc=kpc*1000;
+//the kpc of fit_nfw_mass
+const double nfw_kpc=3.08568e+21;
+// Molecular weight per electron
+// Reference: Ettori et al. 2013, Space Sci. Rev., 177, 119-154; Eq.(9) below
+static const double mu=1.155;
+static const double mp=1.67262158E-24;//g
+static const double M_sun=1.98892E33;//g
+
+typedef std::vector<double> dvec;
+
+double dbeta_func(double r, double n01, double rc1, double beta1,
+                  double n02, double rc2, double beta2)
+{
+  double v1 = abs(n01) * pow(1+r*r/rc1/rc1, -3./2.*abs(beta1));
+  double v2 = abs(n02) * pow(1+r*r/rc2/rc2, -3./2.*abs(beta2));
+  return v1 + v2;
+}
+
+//calculate critical density from z, under following cosmological constants
+static double calc_critical_density(double z,
+				    const double H0=2.3E-18,
+				      const double Omega_m=.27)
+{
+  const double G=6.673E-8;//cm^3 g^-1 s^2
+  const double E=std::sqrt(Omega_m*(1+z)*(1+z)*(1+z)+1-Omega_m);
+  const double H=H0*E;
+  return 3*H*H/8/pi/G;
+}
+
+//the inputs shared by the replicas
+struct mc_setup
+{
+  cfg_map cfg;
+  bool dbeta;
+  bool tie_beta;
+  bool varpro;
+  fit_schedule<dvec,dvec,dvec,double,std::string> sched;
+  double nfw_rmin_kpc;
+  profile_data tprofile;
+  std::vector<tprofile_param> tparams;
+  profile_data sbp;
+  //number of the inner bins cut by rmin, and the radii of the rest
+  size_t num_cut;
+  dvec radii;
+  cfunc_table cft;
+  //integration grid, with dr=r/100
+  dvec rlist;
+  counter_rng rng;
+};
+
+//the profiles of a replica, each as rows (x, y)
+enum
+  {
+    mass_profile,
+    overdensity_profile,
+    gas_mass_profile,
+    entropy_profile,
+    num_profiles
+  };
+
+struct mc_profiles
+{
+  dvec x[num_profiles];
+  dvec y[num_profiles];
+};
+
+//the values at each overdensity of the results of the script
+enum
+  {
+    delta_r,
+    delta_m,
+    delta_gas_m,
+    delta_gas_fraction,
+    num_delta_values
+  };
+static const double deltas[]={200,500,1500,2500};
+static const size_t num_deltas=sizeof(deltas)/sizeof(deltas[0]);
+//the confidence level of analyze_mass_profile.py
+static const double confidence_level=.68;
+
+//fit the density model to the SBP sbps, and return the parameters by
+//name
+static std::map<std::string,double> fit_sbp(const mc_setup& s,const dvec& sbps,const dvec& sbpe,
+                                            const spline_func_obj& cf)
+{
+  const cfg_map& cfg=s.cfg;
+  default_data_set<dvec,dvec> ds;
+  ds.add_data(data<dvec,dvec>(s.radii,sbps,sbpe,sbpe,s.radii,s.radii));
+  fitter<dvec,dvec,dvec,double,std::string> f;
+  f.load_data(ds);
+  projector<double> a;
+  if(!s.dbeta)
+    {
+      a.attach_model(beta<double>());
+    }
+  else if(s.tie_beta)
+    {
+      a.attach_model(dbeta2<double>());
+    }
+  else
+    {
+      a.attach_model(dbeta<double>());
+    }
+  a.attach_cfunc(cf);
+  a.set_cm_per_pixel(cfg.cm_per_pixel);
+  f.set_model(a);
+  vchisq<double> c;
+  c.set_limit();
+  varpro_chisq<double> vc;
+  if(!s.dbeta)
+    {
+      vc.add_scale_param("n0",2);
+    }
+  vc.set_offset_param("bkg");
+  vc.set_limit();
+  if(s.varpro)
+    {
+      f.set_statistic(vc);
+    }
+  else
+    {
+      f.set_statistic(c);
+    }
+  //the initial values and limits, as by the tools
+  if(s.dbeta)
+    {
+      const char* betas[]={"beta1","beta2"};
+      for(size_t i=0;i<2;++i)
+	{
+	  const char* pname=s.tie_beta?"beta":betas[i];
+	  f.set_param_value(pname,.7);
+	  f.set_param_lower_limit(pname,.3);
+	  f.set_param_upper_limit(pname,1.4);
+	}
+    }
+  for(std::map<std::string,std::vector<double> >::const_iterator i=cfg.param_map.begin();
+      i!=cfg.param_map.end();++i)
+    {
+      const std::string& pname=i->first;
+      f.set_param_value(pname,i->second.at(0));
+      if(i->second.size()==3)
+	{
+	  f.set_param_upper_limit(pname,std::max(i->second[1],i->second[2]));
+	  f.set_param_lower_limit(pname,std::min(i->second[1],i->second[2]));
+	}
+      else if(pname=="beta"||pname=="beta1"||pname=="beta2")
+	{
+	  f.set_param_lower_limit(pname,.3);
+	  f.set_param_upper_limit(pname,1.4);
+	}
+    }
+
+  fit_schedule<dvec,dvec,dvec,double,std::string> sched(s.sched);
+  sched.run(f);
+  if(s.varpro)
+    {
+      dynamic_cast<varpro_chisq<double>&>(f.get_statistic()).solve_amplitudes();
+    }
+  std::map<std::string,double> solution;
+  for(size_t i=0;i<f.get_num_params();++i)
+    {
+      solution[f.get_param_info(i).get_name()]=f.get_param_info(i).get_value();
+    }
+  return solution;
+}
+
+//the parameters of dbeta_func of a solution of fit_sbp()
+static dvec density_params(const mc_setup& s,std::map<std::string,double>& solution)
+{
+  dvec p(6);
+  if(!s.dbeta)
+    {
+      p[0]=solution["n0"];
+      p[1]=solution["rc"];
+      p[2]=solution["beta"];
+      //no second component
+      p[3]=0;
+      p[4]=1;
+      p[5]=1;
+      return p;
+    }
+  p[0]=solution["n01"];
+  p[1]=solution["rc1"];
+  p[2]=solution[s.tie_beta?"beta":"beta1"];
+  p[3]=solution["n02"];
+  p[4]=solution["rc2"];
+  p[5]=solution[s.tie_beta?"beta":"beta2"];
+  return p;
+}
+
+//the temperature profile, and the cooling function on it up to the
+//last radius of the SBP; false if it is out of the table
+static bool make_profiles(const mc_setup& s,const dvec& xs,const dvec& ts,
+                          spline_func_obj& Tprof,spline_func_obj& cf)
+{
+  for(size_t i=0;i<xs.size();++i)
+    {
+      Tprof.add_point(xs[i],ts[i]);
+      double cfv;
+      if(!s.cft.eval(ts[i],cfv))
+	{
+	  cerr<<"temperature "<<ts[i]<<" is out of the cooling function table"<<endl;
+	  return false;
+	}
+      if(xs[i]<=s.radii.back())
+	{
+	  cf.add_point(xs[i],cfv);
+	}
+    }
+  Tprof.gen_spline();
+  cf.gen_spline();
+  return true;
+}
+
+//the profiles pr of the temperature profile and SBP tprofile and sbp;
+//false if they fail
+static bool calc_profiles(const mc_setup& s,const profile_data& tprofile,const profile_data& sbp,
+                          mc_profiles& pr)
+{
+  const cfg_map& cfg=s.cfg;
+  const double cm_per_pixel=cfg.cm_per_pixel;
+
+  //temperature profile, and the cooling function on it
+  std::vector<tprofile_param> tparams(s.tparams);
+  dvec xs,ts;
+  fit_tprofile(tprofile,tparams,1,xs,ts);
+  spline_func_obj Tprof;
+  spline_func_obj cf;
+  if(!make_profiles(s,xs,ts,Tprof,cf))
+    {
+      return false;
+    }
+
+  //density profile
+  const dvec sbps(sbp.y.begin()+s.num_cut,sbp.y.end());
+  const dvec sbpe(sbp.ye.begin()+s.num_cut,sbp.ye.end());
+  std::map<std::string,double> solution=fit_sbp(s,sbps,sbpe,cf);
+  const dvec p=density_params(s,solution);
+
+  //mass, gas mass and entropy profiles, as by fit_*_sbp
+  const dvec& rlist=s.rlist;
+  const size_t nr=rlist.size();
+  dvec r1list(nr),T_list(nr),T1_list(nr);
+  for(size_t i=0;i<nr;++i)
+    {
+      r1list[i]=rlist[i]+rlist[i]/100;
+    }
+  Tprof.eval_batch(&rlist[0],&T_list[0],nr);
+  Tprof.eval_batch(&r1list[0],&T1_list[0],nr);
+  default_data_set<double,double> ds_mass;
+  double gas_mass=0;
+  for(size_t i=0;i<nr;++i)
+    {
+      double r=rlist[i];
+      double dr=r/100;
+      double r1=r+dr;
+      double r_cm=r*cm_per_pixel;
+      double r1_cm=r1*cm_per_pixel;
+      double dr_cm=dr*cm_per_pixel;
+      double V_cm3=4./3.*pi*(dr_cm*(r1_cm*r1_cm+r_cm*r_cm+r_cm*r1_cm));
+      double ne=dbeta_func(r,p[0],p[1],p[2],p[3],p[4],p[5]);//cm^-3
+      double ne1=dbeta_func(r1,p[0],p[1],p[2],p[3],p[4],p[5]);//cm^-3
+      double T_keV=T_list[i];
+      double T1_keV=T1_list[i];
+      double dlnT=log(T1_keV/T_keV);
+      double dlnr=log(r+dr)-log(r);
+      double dlnn=log(ne1/ne);
+      double r_Mpc=r_cm/Mpc;
+      //ref:http://adsabs.harvard.edu/abs/2012MNRAS.422.3503W
+      //Walker et al. 2012
+      double M=-3.68E13*M_sun*T_keV*r_Mpc*(dlnT/dlnr+dlnn/dlnr);
+      double S=T_keV/pow(ne,2./3.);
+      gas_mass+=V_cm3*ne*mu*mp/M_sun;
+
+      double r_kpc=r*cm_per_pixel/kpc;
+      pr.x[gas_mass_profile].push_back(r_kpc);
+      pr.y[gas_mass_profile].push_back(gas_mass);
+      pr.x[entropy_profile].push_back(r_kpc);
+      pr.y[entropy_profile].push_back(S);
+      //the rows of mass_int.dat that fit_nfw_mass reads
+      if(r<s.radii.back()&&r_kpc>=s.nfw_rmin_kpc)
+	{
+	  ds_mass.add_data(data<double,double>(r_kpc,M/M_sun,M/M_sun*.1,M/M_sun*.1,0,0));
+	}
+    }
+  if(ds_mass.size()==0)
+    {
+      cerr<<"no mass data beyond nfw_rmin_kpc"<<endl;
+      return false;
+    }
+
+  //NFW model, as by fit_nfw_mass
+  fitter<double,double,dvec,double,std::string> fit;
+  fit.load_data(ds_mass);
+  fit.set_opt_method(powell_method<double,dvec>());
+  fit.set_statistic(chisq<double,double,dvec,double,std::string>());
+  fit.set_model(nfw<double>());
+  fit_controller<double,double,dvec,double,std::string> fc;
+  fc.set_max_fits(3);
+  const dvec pn=fc.fit(fit);
+  const double rho_c=calc_critical_density(cfg.z);
+  for(double x=std::max(s.nfw_rmin_kpc,ds_mass.get_data(0).get_x());;x+=1)
+    {
+      double model_value=fit.eval_model(x,pn);
+      pr.x[mass_profile].push_back(x);
+      pr.y[mass_profile].push_back(model_value);
+      double V=4./3.*pi*pow(x*nfw_kpc,3);
+      double over_density=model_value*M_sun/V/rho_c;
+      pr.x[overdensity_profile].push_back(x);
+      pr.y[overdensity_profile].push_back(over_density);
+      //also stops on a NaN
+      if(!(over_density>=100))
+	{
+	  break;
+	}
+    }
+  return true;
+}
+
+//run the replica No. id; false if it fails
+static bool run_replica(const mc_setup& s,size_t id,mc_profiles& pr)
+{
+  const profile_data tprofile=shuffle_profile(s.tprofile,s.rng,id,mc_tprofile);
+  const profile_data sbp=shuffle_profile(s.sbp,s.rng,id,mc_sbp);
+  return calc_profiles(s,tprofile,sbp,pr);
+}
+
+//read the 2-column profile of file into the profile k of pr; false if
+//it cannot be opened
+static bool read_center_profile(const std::string& file,size_t k,mc_profiles& pr)
+{
+  ifstream ifs(file.c_str());
+  if(!ifs.is_open())
+    {
+      return false;
+    }
+  std::string line;
+  while(std::getline(ifs,line))
+    {
+      std::istringstream iss(line);
+      double x,y;
+      if(iss>>x>>y)
+	{
+	  pr.x[k].push_back(x);
+	  pr.y[k].push_back(y);
+	}
+    }
+  return true;
+}
+
+//r, M, gas mass and gas fraction v of the profiles pr at the
+//overdensity delta, as analyze_mass_profile.py: at the first radius of
+//overdensity below delta, among those of masses of at least mmin; for
+//a replica (monotonic), the masses up to it must not decrease, or it
+//is invalid; false if not found
+static bool delta_values(const mc_profiles& pr,double delta,double mmin,bool monotonic,
+                         double v[num_delta_values],bool& invalid)
+{
+  const dvec& r=pr.x[mass_profile];
+  const dvec& m=pr.y[mass_profile];
+  const dvec& od=pr.y[overdensity_profile];
+  invalid=false;
+  double old_m=0;
+  for(size_t i=0;i<r.size()&&i<od.size();++i)
+    {
+      if(m[i]<mmin)
+	{
+	  continue;
+	}
+      if(monotonic&&m[i]<old_m)
+	{
+	  invalid=true;
+	  return false;
+	}
+      if(od[i]<delta)
+	{
+	  const dvec& rg=pr.x[gas_mass_profile];
+	  for(size_t j=0;j<rg.size();++j)
+	    {
+	      if(rg[j]>r[i])
+		{
+		  v[delta_r]=r[i];
+		  v[delta_m]=m[i];
+		  v[delta_gas_m]=pr.y[gas_mass_profile][j];
+		  v[delta_gas_fraction]=v[delta_gas_m]/m[i];
+		  return true;
+		}
+	    }
+	  return false;
+	}
+      old_m=m[i];
+    }
+  return false;
+}
+
+//the profiles pr as written in os, i.e., as read by
+//analyze_mass_profile.py, to the digits written
+static void read_written(const std::ostringstream os[num_profiles],mc_profiles& pr)
+{
+  for(size_t k=0;k<num_profiles;++k)
+    {
+      std::istringstream is(os[k].str());
+      std::string x,y;
+      while(is>>x>>y)
+	{
+	  //strtod, unlike >>, also reads nan and inf
+	  pr.x[k].push_back(strtod(x.c_str(),NULL_PTR));
+	  pr.y[k].push_back(strtod(y.c_str(),NULL_PTR));
+	}
+    }
+}
+
+//the line of analyze_mass_profile.py of the value k at the overdensity
+//delta, whose interval is lower to upper
+static void write_delta_value(ostream& os,double delta,size_t k,double center,
+                              double lower,double upper)
+{
+  static const char* names[]={"r","m","gas_m","gas_fraction"};
+  static const char* units[]={" kpc"," solar mass"," solar mass",""};
+  os<<names[k]<<delta<<"=\t";
+  if(k==delta_r)
+    {
+      //truncated, as by "%d"
+      os<<int(center)<<"\t "<<int(lower-center)<<"/+"<<int(upper-center);
+    }
+  else
+    {
+      os<<std::scientific<<std::setprecision(6)
+	<<center<<"\t "<<lower-center<<"/+"<<upper-center;
+      os.unsetf(std::ios_base::floatfield);
+    }
+  os<<units[k]<<" (1 sigma)"<<endl;
+}
+
+int main(int argc,char* argv[])
+{
+  if(argc<3)
+    {
+      cerr<<argv[0]<<" <mass.conf> <cfunc_table> [number of replicas|<first>-<last>]"
+	  <<" [number of threads] [seed]"<<endl;
+      return -1;
+    }
+  size_t first_replica=0,num_replicas=100;
+  if(argc>=4&&!parse_replicas(argv[3],first_replica,num_replicas))
+    {
+      cerr<<"invalid replicas: "<<argv[3]<<endl;
+      return -1;
+    }
+  const int num_threads=argc>=5?atoi(argv[4]):0;
+  const unsigned long long seed=argc>=6?strtoull(argv[5],NULL_PTR,10):1;
+#ifdef _OPENMP
+  if(num_threads>0)
+    {
+      omp_set_num_threads(num_threads);
+    }
+#else
+  if(num_threads>1)
+    {
+      cerr<<"built without OpenMP, the replicas run serially"<<endl;
+    }
+#endif
+
+  mc_setup s;
+  s.rng=counter_rng(seed);
+  //the keys of mass.conf used by the Monte Carlo loop
+  std::map<std::string,std::string> mass_cfg;
+  if(!read_mass_cfg(argv[1],mass_cfg))
+    {
+      cerr<<"cannot open file: "<<argv[1]<<endl;
+      return -1;
+    }
+  s.nfw_rmin_kpc=mass_cfg.count("nfw_rmin_kpc")?atof(mass_cfg["nfw_rmin_kpc"].c_str()):1;
+  const std::string tprofile_data=mass_cfg["tprofile_data"];
+  const std::string tprofile_cfg=mass_cfg["tprofile_cfg"];
+  const std::string sbp_cfg=mass_cfg["sbp_cfg"];
+  ifstream cfg_file(sbp_cfg.c_str());
+  if(!cfg_file.is_open())
+    {
+      cerr<<"cannot open the sbp_cfg: "<<sbp_cfg<<endl;
+      return -1;
+    }
+  s.cfg=parse_cfg_file(cfg_file);
+  const cfg_map& cfg=s.cfg;
+  if(cfg.omp_min_bins>0)
+    {
+      set_omp_min_bins(cfg.omp_min_bins);
+    }
+  if(!read_profile(tprofile_data,s.tprofile)||!read_tprofile_params(tprofile_cfg,s.tparams)
+     ||!read_profile(cfg.sbp_data,s.sbp))
+    {
+      cerr<<"cannot read the profiles: "<<tprofile_data<<", "<<tprofile_cfg
+	  <<", "<<cfg.sbp_data<<endl;
+      return -1;
+    }
+  if(!s.cft.load(argv[2]))
+    {
+      cerr<<"cannot read the cooling function table: "<<argv[2]<<endl;
+      return -1;
+    }
+
+  //single- or double-beta model, by the parameters of the config
+  const std::map<std::string,std::vector<double> >& pm=cfg.param_map;
+  s.dbeta=pm.count("n01")||pm.count("n02")||pm.count("beta1")||pm.count("beta2");
+  s.tie_beta=s.dbeta&&pm.count("beta")&&!pm.count("beta1")&&!pm.count("beta2");
+  if(s.dbeta&&!s.tie_beta&&pm.count("beta"))
+    {
+      cerr<<"Error, cannot decide whether to tie beta together or let them vary freely!"<<endl;
+      return -1;
+    }
+  s.varpro=cfg.fit_mode=="varpro";
+  if(!s.varpro&&cfg.fit_mode!="normal")
+    {
+      cerr<<"unknown fit_mode: "<<cfg.fit_mode<<endl;
+      return -1;
+    }
+
+  //the fits of the tools: one stage refitted twice for the single-beta
+  //model, the fit_stage lines or the default schedule for the
+  //double-beta model
+  if(s.dbeta)
+    {
+      for(size_t i=0;i<cfg.fit_stages.size();++i)
+	{
+	  fit_stage st;
+	  if(!parse_fit_stage(cfg.fit_stages[i],st))
+	    {
+	      cerr<<"invalid fit_stage: "<<cfg.fit_stages[i]<<endl;
+	      return -1;
+	    }
+	  s.sched.add_stage(st);
+	}
+    }
+  if(s.sched.get_num_stages()==0)
+    {
+      fit_stage s1(cfg.opt_method);
+      if(s.dbeta)
+	{
+	  if(s.tie_beta)
+	    {
+	      s1.frozen.push_back("beta");
+	    }
+	  else
+	    {
+	      s1.frozen.push_back("beta1");
+	      s1.frozen.push_back("beta2");
+	    }
+	  s1.frozen.push_back("rc1");
+	  s1.frozen.push_back("rc2");
+	  s.sched.add_stage(s1);
+	  fit_stage s2(cfg.opt_method);
+	  s2.max_fits=2;
+	  s2.num_starts=cfg.num_starts;
+	  s.sched.add_stage(s2);
+	}
+      else
+	{
+	  s1.max_fits=2;
+	  s.sched.add_stage(s1);
+	}
+    }
+  //fail here, not in each replica, on an unknown method
+  for(size_t i=0;i<s.sched.get_num_stages();++i)
+    {
+      fitter<dvec,dvec,dvec,double,std::string> probe;
+      if(!set_opt_method_by_name(probe,s.sched.get_stage(i).opt_method))
+	{
+	  cerr<<"unknown opt_method: "<<s.sched.get_stage(i).opt_method<<endl;
+	  return -1;
+	}
+    }
+  if(cfg.fit_max_evals>0)
+    {
+      s.sched.set_max_evals(cfg.fit_max_evals);
+    }
+  if(cfg.fit_max_seconds>0)
+    {
+      s.sched.set_max_seconds(cfg.fit_max_seconds);
+    }
+  if(s.varpro)
+    {
+      if(!s.dbeta)
+	{
+	  s.sched.add_held_param("n0");
+	}
+      s.sched.add_held_param("bkg");
+    }
+
+  //the radii of the SBP, with the zero point, and the inner bins cut
+  double rmin=cfg.rmin_pixel>0?cfg.rmin_pixel:cfg.rmin_kpc*kpc/cfg.cm_per_pixel;
+  s.radii.push_back(0);
+  for(size_t i=0;i<s.sbp.size();++i)
+    {
+      s.radii.push_back(s.sbp.x[i]+s.sbp.xe[i]);
+    }
+  s.num_cut=0;
+  while(s.num_cut<s.radii.size()&&s.radii[s.num_cut]<rmin)
+    {
+      ++s.num_cut;
+    }
+  s.radii.erase(s.radii.begin(),s.radii.begin()+s.num_cut);
+  if(s.radii.size()<2)
+    {
+      cerr<<"no SBP data beyond rmin="<<rmin<<" (pixel)"<<endl;
+      return -1;
+    }
+  double dr=1;
+  for(double r=1;r<200000;r+=dr)
+    {
+      dr=r/100;
+      s.rlist.push_back(r);
+    }
+
+  //the fits to the data themselves, from whose solutions the replicas
+  //start; the temperature profile from 8 starts, as fit_wang2012_model
+  //does, while each replica refits it from the single start of this
+  //solution
+  mc_profiles center;
+  try
+    {
+      dvec xs,ts;
+      fit_tprofile(s.tprofile,s.tparams,8,xs,ts);
+      spline_func_obj Tprof;
+      spline_func_obj cf;
+      if(!make_profiles(s,xs,ts,Tprof,cf))
+	{
+	  return -1;
+	}
+      const dvec sbps(s.sbp.y.begin()+s.num_cut,s.sbp.y.end());
+      const dvec sbpe(s.sbp.ye.begin()+s.num_cut,s.sbp.ye.end());
+      const std::map<std::string,double> solution=fit_sbp(s,sbps,sbpe,cf);
+      for(std::map<std::string,double>::const_iterator i=solution.begin();
+	  i!=solution.end();++i)
+	{
+	  std::vector<double>& v=s.cfg.param_map[i->first];
+	  v.resize(std::max(v.size(),size_t(1)));
+	  v[0]=i->second;
+	}
+      //the center profiles of the script, or else those of the data
+      if(!read_center_profile("mass_int_center.qdp",mass_profile,center)
+	 ||!read_center_profile("overdensity_center.qdp",overdensity_profile,center)
+	 ||!read_center_profile("gas_mass_int_center.qdp",gas_mass_profile,center))
+	{
+	  center=mc_profiles();
+	  if(!calc_profiles(s,s.tprofile,s.sbp,center))
+	    {
+	      cerr<<"the profiles of the data failed"<<endl;
+	      return -1;
+	    }
+	}
+    }
+  catch(const opt_exception& e)
+    {
+      cerr<<"the fit to the data failed: "<<e.what()<<endl;
+      return -1;
+    }
+
+  const char* summary_names[]={"summary_mass_profile","summary_overdensity",
+			       "summary_gas_mass_profile","summary_entropy"};
+  ofstream summary[num_profiles];
+  for(size_t k=0;k<num_profiles;++k)
+    {
+      summary[k].open((std::string(summary_names[k])+".qdp").c_str());
+      //a QDP comment, from which the run can be repeated
+      summary[k]<<"! seed "<<seed<<endl;
+    }
+  cerr<<"seed: "<<seed<<endl;
+  //the statistics of the profiles, and of the values at each
+  //overdensity around those of the center
+  dvec quantiles;
+  quantiles.push_back(.1585);
+  quantiles.push_back(.5);
+  quantiles.push_back(.8415);
+  std::vector<profile_stat> pstat(num_profiles,profile_stat(quantiles));
+  std::vector<scalar_stat> dstat;
+  std::vector<size_t> num_invalid(num_deltas,0);
+  for(size_t d=0;d<num_deltas;++d)
+    {
+      //zero if not found, as by the script, so that it is not enclosed
+      double v[num_delta_values]={0,0,0,0};
+      bool invalid;
+      delta_values(center,deltas[d],1e11,false,v,invalid);
+      for(size_t k=0;k<num_delta_values;++k)
+	{
+	  dstat.push_back(scalar_stat(v[k]));
+	}
+    }
+  const double t0=wall_time();
+  size_t num_failed=0;
+#ifdef _OPENMP
+#pragma omp parallel for ordered schedule(dynamic)
+#endif
+  for(int i=0;i<int(num_replicas);++i)
+    {
+      mc_profiles pr;
+      std::ostringstream os[num_profiles];
+      bool ok=false;
+      try
+	{
+	  ok=run_replica(s,first_replica+i,pr);
+	}
+      catch(const opt_exception& e)
+	{
+	  cerr<<"replica "<<first_replica+i+1<<": "<<e.what()<<endl;
+	}
+      for(size_t k=0;ok&&k<num_profiles;++k)
+	{
+	  for(size_t j=0;j<pr.x[k].size();++j)
+	    {
+	      os[k]<<pr.x[k][j]<<"\t"<<pr.y[k][j]<<endl;
+	    }
+	}
+      //the values at the overdensities are taken from the profiles as
+      //written, as by the script
+      mc_profiles written;
+      if(ok)
+	{
+	  read_written(os,written);
+	}
+      //written and added to the statistics in the order of the replicas
+#ifdef _OPENMP
+#pragma omp ordered
+#endif
+      {
+	if(ok)
+	  {
+	    for(size_t k=0;k<num_profiles;++k)
+	      {
+		summary[k]<<os[k].str()<<"no no no"<<endl;
+		pstat[k].add(pr.x[k],pr.y[k]);
+	      }
+	    for(size_t d=0;d<num_deltas;++d)
+	      {
+		double v[num_delta_values];
+		bool invalid;
+		if(delta_values(written,deltas[d],1e12,true,v,invalid))
+		  {
+		    for(size_t k=0;k<num_delta_values;++k)
+		      {
+			dstat[d*num_delta_values+k].add(v[k]);
+		      }
+		  }
+		else if(invalid)
+		  {
+		    ++num_invalid[d];
+		  }
+	      }
+	  }
+	else
+	  {
+	    ++num_failed;
+	  }
+	cerr<<"## "<<first_replica+i+1<<" / "<<first_replica+num_replicas<<" ##"<<endl;
+      }
+    }
+  cerr<<num_replicas-num_failed<<" of "<<num_replicas<<" replicas done in "
+      <<wall_time()-t0<<" s"<<endl;
+
+  for(size_t k=0;k<num_profiles;++k)
+    {
+      ofstream ofs((std::string(summary_names[k])+"_stat.qdp").c_str());
+      ofs<<"! seed "<<seed<<endl;
+      ofs<<"! x n mean std q15.85 q50 q84.15"<<endl;
+      pstat[k].write(ofs);
+    }
+  //in the format of analyze_mass_profile.py
+  ofstream ofs_delta("summary_delta.txt");
+  for(size_t d=0;d<num_deltas;++d)
+    {
+      const scalar_stat* st=&dstat[d*num_delta_values];
+      ofs_delta<<num_invalid[d]<<" abnormal data dropped"<<endl;
+      double lower[num_delta_values],upper[num_delta_values];
+      bool enclosed=true;
+      for(size_t k=0;k<num_delta_values;++k)
+	{
+	  enclosed=st[k].interval(confidence_level,lower[k],upper[k])&&enclosed;
+	}
+      const size_t order[]={delta_m,delta_gas_m,delta_gas_fraction,delta_r};
+      if(!enclosed)
+	{
+	  ofs_delta<<"Error, the center value is not enclosed by the Monte-Carlo realizations,"
+		   <<" please check the result!"<<endl;
+	  //the central value and the range of the values
+	  static const char* names[]={"r","m","gm","gf"};
+	  for(size_t i=0;i<num_delta_values&&st[0].size()>0;++i)
+	    {
+	      const size_t k=order[i];
+	      ofs_delta<<names[k]<<":"<<std::scientific<<std::uppercase<<std::setprecision(6)
+		       <<st[k].get_center()<<" "<<st[k].min()<<" "<<st[k].max()<<endl;
+	      ofs_delta.unsetf(std::ios_base::floatfield|std::ios_base::uppercase);
+	    }
+	  continue;
+	}
+      for(size_t i=0;i<num_delta_values;++i)
+	{
+	  const size_t k=order[i];
+	  write_delta_value(ofs_delta,deltas[d],k,st[k].get_center(),lower[k],upper[k]);
+	}
+    }
+  return num_failed<num_replicas?0:1;
+}
@@ -10,6 +10,8 @@
 #include <data_sets/default_data_set.hpp>
 #include "chisq.hpp"
 #include <methods/powell/powell_method.hpp>
+#include "lm_method.hpp"
+#include "fit_controller.hpp"
 #include <iostream>
 #include <fstream>
 #include <vector>
@@ -35,7 +37,7 @@ int main(int argc,char* argv[])
 {
   if(argc<3)
     {
-      cerr<<"Usage:"<<argv[0]<<" <data file with 4 columns of x, xe, y, ye> <z> [rmin in kpc]"<<endl;
+      cerr<<"Usage:"<<argv[0]<<" <data file with 4 columns of x, xe, y, ye> <z> [rmin in kpc] [opt method: powell|lm]"<<endl;
       return -1;
     }
   double rmin_kpc=1;
@@ -97,15 +99,23 @@ int main(int argc,char* argv[])
   //load data
   fit.load_data(ds);
   //define the optimization method
-  fit.set_opt_method(powell_method<double,vector<double> >());
+  std::string opt_method_name(argc>=5?argv[4]:"powell");
+  if(!set_opt_method_by_name(fit,opt_method_name))
+    {
+      cerr<<"unknown opt method: "<<opt_method_name<<endl;
+      return -1;
+    }
   //use chi^2 statistic
   fit.set_statistic(chisq<double,double,vector<double>,double,std::string>());
   fit.set_model(nfw<double>());
   //fit.set_param_value("rs",4);
   //fit.set_param_value("rho0",100);
-  fit.fit();
-  fit.fit();
-  vector<double> p=fit.fit();
+  //refit while it improves (three times at most), within the budgets
+  fit_controller<double,double,vector<double>,double,std::string> fc;
+  fc.set_max_fits(3);
+  vector<double> p=fc.fit(fit);
+  cerr<<"fit stopped: "<<fc.get_stop_reason_name()<<", after "
+      <<fc.get_num_fits()<<" fits and "<<fc.get_num_evals()<<" evaluations"<<endl;
   //output parameters
   ofstream ofs_param("nfw_param.txt");
   for(size_t i=0;i<fit.get_num_params();++i)
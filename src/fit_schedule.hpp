@@ -0,0 +1,278 @@
+#ifndef FIT_SCHEDULE_HPP
+#define FIT_SCHEDULE_HPP
+/*
+  Staged fit schedule
+
+  Runs a list of fit_stage on one fitter.  Each stage freezes some
+  parameters at their current values, selects the optimization method
+  and its tolerance, and fits with a fit_controller, or from several
+  starting points with multi_start.  The stages warm-start from each
+  other: they change only the param_modifier, the method and the
+  precision of the fitter, never its model, statistic or data set.
+  A stage is written in the config files as
+    fit_stage <opt_method> [freeze=<p1>,<p2>,...] [tolerance=<t>]
+              [fits=<n>] [starts=<n>]
+  e.g., the default schedule of the double-beta fits is
+    fit_stage powell freeze=beta1,beta2,rc1,rc2
+    fit_stage powell fits=2 starts=8
+  A stage with one start (the default) fits the fitter in place; with
+  starts>1, multi_start copies the fitter, with its model, data set and
+  caches, once per thread.
+*/
+
+#include <core/fitter.hpp>
+#include <core/freeze_param.hpp>
+#include "lm_method.hpp"
+#include "fit_controller.hpp"
+#include "multi_start.hpp"
+#include "transform_param.hpp"
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <cstdlib>
+
+namespace opt_utilities
+{
+  struct fit_stage
+  {
+    //"powell" or "lm"
+    std::string opt_method;
+    //the parameters held at their current values
+    std::vector<std::string> frozen;
+    //precision of the method, and relative improvement below which the
+    //refits stop; 0 keeps those of the previous stage
+    double tolerance;
+    //maximum number of fit() calls of each start
+    size_t max_fits;
+    //number of starting points, 1 for the current parameters only
+    size_t num_starts;
+
+    fit_stage(const std::string& m="powell")
+      :opt_method(m),tolerance(0),max_fits(1),num_starts(1)
+    {}
+  };
+
+  //parse the fields of a fit_stage line that follow the key; false on
+  //an unknown or malformed field
+  inline bool parse_fit_stage(const std::string& line,fit_stage& s)
+  {
+    std::istringstream iss(line);
+    s=fit_stage();
+    if(!(iss>>s.opt_method))
+      {
+        return false;
+      }
+    std::string field;
+    while(iss>>field)
+      {
+        const size_t eq=field.find('=');
+        if(eq==std::string::npos||eq+1==field.size())
+          {
+            return false;
+          }
+        const std::string key(field.substr(0,eq));
+        const std::string value(field.substr(eq+1));
+        char* end=NULL_PTR;
+        if(key=="freeze")
+          {
+            std::istringstream names(value);
+            std::string name;
+            while(getline(names,name,','))
+              {
+                if(!name.empty())
+                  {
+                    s.frozen.push_back(name);
+                  }
+              }
+            continue;
+          }
+        else if(key=="tolerance")
+          {
+            s.tolerance=std::strtod(value.c_str(),&end);
+          }
+        else if(key=="fits")
+          {
+            s.max_fits=std::strtoul(value.c_str(),&end,10);
+          }
+        else if(key=="starts")
+          {
+            s.num_starts=std::strtoul(value.c_str(),&end,10);
+          }
+        else
+          {
+            return false;
+          }
+        if(*end!='\0')
+          {
+            return false;
+          }
+      }
+    return true;
+  }
+
+  template <typename Ty,typename Tx,typename Tp,typename Ts,typename Tstr=std::string>
+  class fit_schedule
+  {
+  private:
+    std::vector<fit_stage> stages;
+    std::vector<std::string> held;
+    size_t max_evals;
+    double max_seconds;
+    bool transform;
+    bool verb;
+
+  public:
+    fit_schedule()
+      :max_evals(FIT_MAX_EVALS),max_seconds(FIT_MAX_SECONDS),transform(false),verb(false)
+    {}
+
+    void add_stage(const fit_stage& s)
+    {
+      stages.push_back(s);
+    }
+
+    void clear_stages()
+    {
+      stages.clear();
+    }
+
+    size_t get_num_stages()const
+    {
+      return stages.size();
+    }
+
+    const fit_stage& get_stage(size_t i)const
+    {
+      return stages.at(i);
+    }
+
+    //a parameter frozen in every stage, e.g., an amplitude solved by
+    //varpro_chisq
+    void add_held_param(const std::string& name)
+    {
+      held.push_back(name);
+    }
+
+    //budgets of the fits of each stage (and each start), 0 for no limit
+    void set_max_evals(size_t n)
+    {
+      max_evals=n;
+    }
+
+    void set_max_seconds(double t)
+    {
+      max_seconds=t;
+    }
+
+    //fit in the unconstrained space of transform_param in every stage,
+    //which then also freezes the parameters
+    void set_transform(bool t)
+    {
+      transform=t;
+    }
+
+    //report each stage to std::cerr
+    void verbose(bool v)
+    {
+      verb=v;
+    }
+
+  private:
+    //freeze the parameters of s and the held ones, or thaw all if none
+    void apply_frozen(fitter<Ty,Tx,Tp,Ts,Tstr>& f,const fit_stage& s)const
+    {
+      std::vector<std::string> frozen(s.frozen);
+      frozen.insert(frozen.end(),held.begin(),held.end());
+      if(transform)
+        {
+          transform_param<Ty,Tx,Tp,Tstr> tp;
+          for(size_t i=0;i<frozen.size();++i)
+            {
+              tp.freeze(frozen[i]);
+            }
+          f.set_param_modifier(tp);
+          return;
+        }
+      if(frozen.empty())
+        {
+          f.clear_param_modifier();
+          return;
+        }
+      for(size_t i=0;i<frozen.size();++i)
+        {
+          //throws on a parameter the model does not have
+          f.get_model().get_param_order(frozen[i]);
+        }
+      freeze_param<Ty,Tx,Tp,Tstr> fp(frozen[0]);
+      for(size_t i=1;i<frozen.size();++i)
+        {
+          fp=fp+freeze_param<Ty,Tx,Tp,Tstr>(frozen[i]);
+        }
+      f.set_param_modifier(fp);
+    }
+
+    void apply_budgets(fit_controller<Ty,Tx,Tp,Ts,Tstr>& c,const fit_stage& s)const
+    {
+      c.set_max_fits(s.max_fits);
+      c.set_max_evals(max_evals);
+      c.set_max_seconds(max_seconds);
+      if(s.tolerance>0)
+        {
+          c.set_tolerance(s.tolerance);
+        }
+    }
+
+  public:
+    //run the stages in order on f, and return its (full) parameters; the
+    //param_modifier of the last stage is left on f
+    Tp run(fitter<Ty,Tx,Tp,Ts,Tstr>& f)
+    {
+      for(size_t i=0;i<stages.size();++i)
+        {
+          const fit_stage& s=stages[i];
+          apply_frozen(f,s);
+          if(!set_opt_method_by_name(f,s.opt_method))
+            {
+              throw opt_exception("unknown opt_method in fit stage: "+s.opt_method);
+            }
+          if(s.tolerance>0)
+            {
+              f.set_precision(s.tolerance);
+            }
+          if(s.num_starts>1)
+            {
+              multi_start<Ty,Tx,Tp,Ts,Tstr> ms;
+              ms.set_num_starts(s.num_starts);
+              if(s.tolerance>0)
+                {
+                  ms.set_tolerance(s.tolerance);
+                }
+              apply_budgets(ms.get_controller(),s);
+              ms.fit(f);
+              if(verb)
+                {
+                  std::cerr<<"fit stage "<<i+1<<": best of "<<ms.get_starts_run()
+                           <<" starts is No. "<<ms.get_best_start()<<", after "
+                           <<ms.get_num_evals()<<" evaluations"<<std::endl;
+                }
+            }
+          else
+            {
+              fit_controller<Ty,Tx,Tp,Ts,Tstr> fc;
+              apply_budgets(fc,s);
+              fc.fit(f);
+              if(verb)
+                {
+                  std::cerr<<"fit stage "<<i+1<<": "<<fc.get_stop_reason_name()<<", after "
+                           <<fc.get_num_fits()<<" fits and "<<fc.get_num_evals()
+                           <<" evaluations"<<std::endl;
+                }
+            }
+        }
+      return f.get_all_params();
+    }
+  };
+}
+
+#endif
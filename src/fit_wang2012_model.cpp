@@ -10,6 +10,8 @@
 #include <core/fitter.hpp>
 #include <data_sets/default_data_set.hpp>
 #include "chisq.hpp"
+#include "lm_method.hpp"
+#include "multi_start.hpp"
 #include <methods/powell/powell_method.hpp>
 #include <core/freeze_param.hpp>
 #include <iostream>
@@ -26,7 +28,7 @@ int main(int argc,char* argv[])
 {
   if(argc<2)
     {
-      cerr<<"Usage:"<<argv[0]<<" <data file with 4 columns of x, xe, y, ye> [param file] [cm per pixel]"<<endl;
+      cerr<<"Usage:"<<argv[0]<<" <data file with 4 columns of x, xe, y, ye> [param file] [cm per pixel] [opt method: powell|lm] [number of starts]"<<endl;
       return -1;
     }
   double cm_per_pixel=-1;
@@ -81,7 +83,12 @@ int main(int argc,char* argv[])
   //load data
   fit.load_data(ds);
   //define the optimization method
-  fit.set_opt_method(powell_method<double,vector<double> >());
+  std::string opt_method_name(argc>=5?argv[4]:"powell");
+  if(!set_opt_method_by_name(fit,opt_method_name))
+    {
+      cerr<<"unknown opt method: "<<opt_method_name<<endl;
+      return -1;
+    }
   //use chi^2 statistic
   chisq<double,double,vector<double>,double,std::string> chisq_object;
   chisq_object.set_limit();
@@ -130,11 +137,17 @@ int main(int argc,char* argv[])
 	}
     }
 
-  for(int i=0;i<100;++i)
+  //fit from several starting points in parallel, each refitted (up to
+  //101 times) until it stops improving
+  multi_start<double,double,vector<double>,double,std::string> ms;
+  if(argc>=6)
     {
-      fit.fit();
+      ms.set_num_starts(atoi(argv[5]));
     }
-  vector<double> p=fit.fit();
+  ms.set_max_refits(101);
+  vector<double> p=ms.fit(fit);
+  cerr<<"multi-start: best of "<<ms.get_starts_run()<<" starts is No. "
+      <<ms.get_best_start()<<", chi^2="<<ms.get_best_statistic()<<endl;
 #if 0
   ofstream output_param;
   if(argc>=3&&std::string(argv[2])!="NONE")
@@ -0,0 +1,82 @@
+#ifndef FUSED_MODEL_HPP
+#define FUSED_MODEL_HPP
+/*
+  Interface of the models that can write their result into a buffer
+  owned by the caller, instead of returning a new one, e.g., the beta
+  models and the projector.  Callers go through eval_model_into(),
+  which checks for it with dynamic_cast, and falls back to model::eval()
+  otherwise.
+
+  batch_model is the same for many parameter vectors at once, e.g., the
+  projector applies its operator to all of them in one sweep; callers go
+  through eval_model_batch().
+*/
+
+#include <core/fitter.hpp>
+#include <vector>
+
+namespace opt_utilities
+{
+  template <typename Ty,typename Tx,typename Tp>
+  class fused_model
+  {
+  public:
+    virtual ~fused_model()
+    {}
+
+    //same as do_eval(x,p), but writes the result into y, reusing its
+    //storage; p has already been reformed
+    virtual void do_eval_into(const Tx& x,const Tp& p,Ty& y)=0;
+  };
+
+  //y=m.eval(x,p), reusing the storage of y if the model supports it
+  template <typename Ty,typename Tx,typename Tp,typename Tstr>
+  inline void eval_model_into(model<Ty,Tx,Tp,Tstr>& m,const Tx& x,const Tp& p,Ty& y)
+  {
+    fused_model<Ty,Tx,Tp>* pf=dynamic_cast<fused_model<Ty,Tx,Tp>*>(&m);
+    if(pf)
+      {
+        pf->do_eval_into(x,m.reform_param(p),y);
+        return;
+      }
+    y=m.eval(x,p);
+  }
+
+  template <typename Ty,typename Tx,typename Tp>
+  class batch_model
+  {
+  public:
+    virtual ~batch_model()
+    {}
+
+    //ys[k]=do_eval(x,ps[k]) for each k, reusing the storage of ys;
+    //the ps have already been reformed
+    virtual void do_eval_batch(const Tx& x,const std::vector<Tp>& ps,
+                               std::vector<Ty>& ys)=0;
+  };
+
+  //ys[k]=m.eval(x,ps[k]) for each k, in one call if the model supports it
+  template <typename Ty,typename Tx,typename Tp,typename Tstr>
+  inline void eval_model_batch(model<Ty,Tx,Tp,Tstr>& m,const Tx& x,
+                               const std::vector<Tp>& ps,std::vector<Ty>& ys)
+  {
+    batch_model<Ty,Tx,Tp>* pb=dynamic_cast<batch_model<Ty,Tx,Tp>*>(&m);
+    if(pb)
+      {
+        std::vector<Tp> rps(ps.size());
+        for(size_t k=0;k<ps.size();++k)
+          {
+            rps[k]=m.reform_param(ps[k]);
+          }
+        pb->do_eval_batch(x,rps,ys);
+        return;
+      }
+    ys.resize(ps.size());
+    for(size_t k=0;k<ps.size();++k)
+      {
+        eval_model_into(m,x,ps[k],ys[k]);
+      }
+  }
+}
+
+#endif
@@ -0,0 +1,418 @@
+#ifndef LM_METHOD_HPP
+#define LM_METHOD_HPP
+/*
+  Levenberg-Marquardt method for the least-squares fits
+
+  Works on the residuals of a statistic that implements residual_func
+  (chisq and vchisq), with the analytic Jacobian of the statistic if it
+  provides one, otherwise with forward differences.  The steps are
+  clamped into the lower/upper limits given to the method, and a step
+  that violates the limits of the statistic itself is rejected like one
+  that does not reduce the statistic.
+  Stops once the reduction predicted for the undamped (Gauss-Newton)
+  step is less than the precision, relative to the statistic.
+*/
+
+#include <core/fitter.hpp>
+#include <methods/powell/powell_method.hpp>
+#include "residual_func.hpp"
+#include <vector>
+#include <string>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+namespace opt_utilities
+{
+  template <typename rT,typename pT>
+  class lm_method
+    :public opt_method<rT,pT>
+  {
+  private:
+    optimizer<rT,pT>* p_optimizer;
+    rT precision;
+    pT start_point;
+    pT lower_limit;
+    pT upper_limit;
+    int max_iter;
+    size_t num_evals;
+    //the parameters that are not held at a limit in the current step
+    std::vector<size_t> free_index;
+    size_t nfree;
+
+  public:
+    lm_method()
+      :p_optimizer(NULL_PTR),precision(1e-4),max_iter(200),num_evals(0),nfree(0)
+    {}
+
+    void set_max_iter(int n)
+    {
+      max_iter=n;
+    }
+
+    //number of the residual evaluations of the last optimize()
+    size_t get_num_evals()const
+    {
+      return num_evals;
+    }
+
+  private:
+    lm_method<rT,pT>* do_clone()const
+    {
+      return new lm_method<rT,pT>(*this);
+    }
+
+    const char* do_get_type_name()const
+    {
+      return "Levenberg-Marquardt method";
+    }
+
+    void do_set_optimizer(optimizer<rT,pT>& o)
+    {
+      p_optimizer=&o;
+    }
+
+    void do_set_precision(rT x)
+    {
+      precision=x;
+    }
+
+    rT do_get_precision()const
+    {
+      return precision;
+    }
+
+    void do_set_start_point(const pT& p)
+    {
+      start_point=p;
+    }
+
+    pT do_get_start_point()const
+    {
+      return start_point;
+    }
+
+    void do_set_lower_limit(const pT& p)
+    {
+      lower_limit=p;
+    }
+
+    void do_set_upper_limit(const pT& p)
+    {
+      upper_limit=p;
+    }
+
+    pT do_get_lower_limit()const
+    {
+      return lower_limit;
+    }
+
+    pT do_get_upper_limit()const
+    {
+      return upper_limit;
+    }
+
+    void clamp(pT& p)const
+    {
+      for(size_t j=0;j<p.size();++j)
+        {
+          if(j<lower_limit.size()&&p[j]<lower_limit[j])
+            {
+              p[j]=lower_limit[j];
+            }
+          if(j<upper_limit.size()&&p[j]>upper_limit[j])
+            {
+              p[j]=upper_limit[j];
+            }
+        }
+    }
+
+    bool residuals(residual_func<rT>& rf,const pT& p,std::vector<rT>& r)
+    {
+      ++num_evals;
+      return rf.eval_residuals(p,r);
+    }
+
+    //forward differences, stepping backwards at an upper limit
+    void jacobian(residual_func<rT>& rf,const pT& p,const std::vector<rT>& r,
+                  std::vector<rT>& jac)
+    {
+      const size_t np=p.size();
+      const size_t nr=r.size();
+      if(rf.eval_jacobian(p,jac))
+        {
+          return;
+        }
+      jac.assign(nr*np,0);
+      const rT eps=std::sqrt(std::numeric_limits<rT>::epsilon());
+      pT p1(p);
+      std::vector<rT> r1;
+      for(size_t j=0;j<np;++j)
+        {
+          rT h=eps*std::max(std::abs(p[j]),eps);
+          if(j<upper_limit.size()&&p[j]+h>upper_limit[j])
+            {
+              h=-h;
+            }
+          p1[j]=p[j]+h;
+          if(!residuals(rf,p1,r1))
+            {
+              h=-h;
+              p1[j]=p[j]+h;
+              if(!residuals(rf,p1,r1))
+                {
+                  p1[j]=p[j];
+                  continue;
+                }
+            }
+          h=p1[j]-p[j];
+          for(size_t i=0;i<nr;++i)
+            {
+              jac[i*np+j]=(r1[i]-r[i])/h;
+            }
+          p1[j]=p[j];
+        }
+    }
+
+    //solve a*x=b for a symmetric positive definite a (n x n) by Cholesky
+    //decomposition, in place; false if a is not positive definite
+    static bool cholesky_solve(std::vector<rT>& a,std::vector<rT>& b,size_t n)
+    {
+      for(size_t j=0;j<n;++j)
+        {
+          rT d=a[j*n+j];
+          for(size_t k=0;k<j;++k)
+            {
+              d-=a[j*n+k]*a[j*n+k];
+            }
+          if(!(d>0))
+            {
+              return false;
+            }
+          d=std::sqrt(d);
+          a[j*n+j]=d;
+          for(size_t i=j+1;i<n;++i)
+            {
+              rT s=a[i*n+j];
+              for(size_t k=0;k<j;++k)
+                {
+                  s-=a[i*n+k]*a[j*n+k];
+                }
+              a[i*n+j]=s/d;
+            }
+        }
+      for(size_t i=0;i<n;++i)
+        {
+          for(size_t k=0;k<i;++k)
+            {
+              b[i]-=a[i*n+k]*b[k];
+            }
+          b[i]/=a[i*n+i];
+        }
+      for(size_t i=n;i-->0;)
+        {
+          for(size_t k=i+1;k<n;++k)
+            {
+              b[i]-=a[k*n+i]*b[k];
+            }
+          b[i]/=a[i*n+i];
+        }
+      return true;
+    }
+
+    //solve (a+lambda*diag(a))d=-g for the free parameters, d=0 for the
+    //others
+    bool solve_step(const std::vector<rT>& a,const std::vector<rT>& g,rT lambda,
+                    std::vector<rT>& d)const
+    {
+      const size_t np=g.size();
+      std::vector<rT> m(nfree*nfree);
+      std::vector<rT> b(nfree);
+      for(size_t j=0;j<nfree;++j)
+        {
+          const size_t jj=free_index[j];
+          for(size_t k=0;k<nfree;++k)
+            {
+              m[j*nfree+k]=a[jj*np+free_index[k]];
+            }
+          m[j*nfree+j]+=lambda*std::max(a[jj*np+jj],std::numeric_limits<rT>::min());
+          b[j]=-g[jj];
+        }
+      if(!cholesky_solve(m,b,nfree))
+        {
+          return false;
+        }
+      std::fill(d.begin(),d.end(),rT(0));
+      for(size_t j=0;j<nfree;++j)
+        {
+          d[free_index[j]]=b[j];
+        }
+      return true;
+    }
+
+    static rT sum_sq(const std::vector<rT>& r)
+    {
+      rT s=0;
+      for(size_t i=0;i<r.size();++i)
+        {
+          s+=r[i]*r[i];
+        }
+      return s;
+    }
+
+    pT do_optimize()
+    {
+      residual_func<rT>* prf=dynamic_cast<residual_func<rT>*>(p_optimizer->ptr_func_obj());
+      if(!prf)
+        {
+          throw opt_exception("lm_method needs a statistic with residuals");
+        }
+      num_evals=0;
+      pT x(start_point);
+      clamp(x);
+      const size_t np=x.size();
+      std::vector<rT> r;
+      if(!residuals(*prf,x,r))
+        {
+          throw opt_exception("lm_method: start point out of limits");
+        }
+      rT f=sum_sq(r);
+      std::vector<rT> jac,a(np*np),g(np),d(np),rn;
+      pT xn(np);
+      rT lambda=1e-3;
+      rT nu=2;
+      free_index.resize(np);
+      nfree=np;
+      bool new_jac=true;
+      for(int iter=0;iter<max_iter;++iter)
+        {
+          if(new_jac)
+            {
+              jacobian(*prf,x,r,jac);
+              new_jac=false;
+              //normal equations, a=J^T J and g=J^T r
+              const size_t nr=r.size();
+              std::fill(a.begin(),a.end(),rT(0));
+              std::fill(g.begin(),g.end(),rT(0));
+              for(size_t i=0;i<nr;++i)
+                {
+                  const rT* ji=&jac[i*np];
+                  for(size_t j=0;j<np;++j)
+                    {
+                      g[j]+=ji[j]*r[i];
+                      for(size_t k=0;k<=j;++k)
+                        {
+                          a[j*np+k]+=ji[j]*ji[k];
+                        }
+                    }
+                }
+              for(size_t j=0;j<np;++j)
+                {
+                  for(size_t k=0;k<j;++k)
+                    {
+                      a[k*np+j]=a[j*np+k];
+                    }
+                }
+              //the parameters at a limit that the gradient pushes
+              //against are held fixed
+              nfree=0;
+              for(size_t j=0;j<np;++j)
+                {
+                  const bool at_lower=j<lower_limit.size()&&x[j]<=lower_limit[j]&&g[j]>0;
+                  const bool at_upper=j<upper_limit.size()&&x[j]>=upper_limit[j]&&g[j]<0;
+                  if(!at_lower&&!at_upper)
+                    {
+                      free_index[nfree++]=j;
+                    }
+                }
+              //the reduction predicted for the undamped (Gauss-Newton)
+              //step is g^T a^-1 g; converged once it is within the precision
+              if(nfree==0)
+                {
+                  break;
+                }
+              if(solve_step(a,g,0,d))
+                {
+                  rT dec=0;
+                  for(size_t j=0;j<np;++j)
+                    {
+                      dec-=g[j]*d[j];
+                    }
+                  if(dec<=precision*f)
+                    {
+                      break;
+                    }
+                }
+            }
+          //damped step, (a+lambda*diag(a))d=-g
+          bool ok=solve_step(a,g,lambda,d);
+          rT fn=f;
+          if(ok)
+            {
+              for(size_t j=0;j<np;++j)
+                {
+                  xn[j]=x[j]+d[j];
+                }
+              clamp(xn);
+              ok=residuals(*prf,xn,rn);
+              if(ok)
+                {
+                  fn=sum_sq(rn);
+                }
+            }
+          if(ok&&fn<f)
+            {
+              //gain ratio of the actual and the predicted reductions
+              rT pred=0;
+              for(size_t j=0;j<np;++j)
+                {
+                  const rT dj=xn[j]-x[j];
+                  pred-=2*dj*g[j];
+                  for(size_t k=0;k<np;++k)
+                    {
+                      pred-=dj*a[j*np+k]*(xn[k]-x[k]);
+                    }
+                }
+              const rT rho=pred>0?(f-fn)/pred:0;
+              const rT t=2*rho-1;
+              lambda*=std::max(rT(1)/3,1-t*t*t);
+              nu=2;
+              x.swap(xn);
+              r.swap(rn);
+              f=fn;
+              new_jac=true;
+            }
+          else
+            {
+              lambda*=nu;
+              nu*=2;
+              if(lambda>1e20)
+                {
+                  break;
+                }
+            }
+        }
+      return x;
+    }
+  };
+
+  //set the optimization method of a fitter by its name, "powell" (the
+  //default) or "lm"; false if the name is unknown
+  template <typename Ty,typename Tx,typename Tp,typename Ts,typename Tstr>
+  bool set_opt_method_by_name(fitter<Ty,Tx,Tp,Ts,Tstr>& f,const std::string& name)
+  {
+    if(name=="lm")
+      {
+        f.set_opt_method(lm_method<Ts,Tp>());
+        return true;
+      }
+    if(name=="powell"||name.empty())
+      {
+        f.set_opt_method(powell_method<Ts,Tp>());
+        return true;
+      }
+    return false;
+  }
+}
+
+#endif
@@ -0,0 +1,312 @@
+#ifndef MC_AGGREGATE_HPP
+#define MC_AGGREGATE_HPP
+/*
+  Streaming statistics of the Monte Carlo replicas
+
+  The replicas are summarized as they finish:
+    running_stat    mean and variance, by Welford's update;
+    p2_quantiles    quantiles by the P-square algorithm (Jain & Chlamtac
+                    1985), with markers at the bounds of equal cells of
+                    probability (the histogram form of the algorithm);
+                    the quantiles between the markers are interpolated,
+                    and are exact up to a value per marker;
+    profile_stat    the two above at each radius of a profile, in memory
+                    that does not grow with the number of replicas;
+    scalar_stat     the values of a scalar (e.g., r500), one per
+                    replica, and the interval around its central value
+                    by the exact order statistics of
+                    analyze_mass_profile.py, which give the published
+                    errors.
+  The P-square estimates depend on the order of the values, so the
+  replicas are added in their order, not as they finish, to give the
+  same results on any number of threads.
+*/
+
+#include <vector>
+#include <ostream>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+namespace opt_utilities
+{
+  class running_stat
+  {
+  private:
+    size_t n;
+    double m;
+    double m2;
+
+  public:
+    running_stat()
+      :n(0),m(0),m2(0)
+    {}
+
+    void add(double x)
+    {
+      ++n;
+      const double d=x-m;
+      m+=d/n;
+      m2+=d*(x-m);
+    }
+
+    size_t size()const
+    {
+      return n;
+    }
+
+    double mean()const
+    {
+      return m;
+    }
+
+    //the sample variance
+    double variance()const
+    {
+      return n>1?m2/(n-1):0;
+    }
+  };
+
+  class p2_quantiles
+  {
+  private:
+    //probabilities, heights and (0-based) positions of the markers
+    std::vector<double> prob;
+    std::vector<double> q;
+    std::vector<double> pos;
+    size_t n;
+
+    //the position of marker i, also before the markers are placed,
+    //when q holds the values themselves in order
+    double position(size_t i)const
+    {
+      return n<prob.size()?double(i):pos[i];
+    }
+
+  public:
+    //markers at the probabilities p, in increasing order from 0 to 1
+    explicit p2_quantiles(const std::vector<double>& p=std::vector<double>())
+      :prob(p),n(0)
+    {}
+
+    void add(double x)
+    {
+      const size_t m=prob.size();
+      if(n<m)
+        {
+          q.insert(std::upper_bound(q.begin(),q.end(),x),x);
+          if(++n==m)
+            {
+              pos.resize(m);
+              for(size_t i=0;i<m;++i)
+                {
+                  pos[i]=i;
+                }
+            }
+          return;
+        }
+      //the cell of x, whose markers above move up
+      size_t k;
+      if(x<q[0])
+        {
+          q[0]=x;
+          k=0;
+        }
+      else if(x>=q[m-1])
+        {
+          q[m-1]=x;
+          k=m-2;
+        }
+      else
+        {
+          k=std::upper_bound(q.begin(),q.end(),x)-q.begin()-1;
+        }
+      for(size_t i=k+1;i<m;++i)
+        {
+          pos[i]+=1;
+        }
+      ++n;
+      //the inner markers off their desired positions by one or more
+      //move by one, with their heights adjusted by the piecewise
+      //parabolic formula, or linearly if that breaks the order
+      for(size_t i=1;i+1<m;++i)
+        {
+          const double d=prob[i]*(n-1)-pos[i];
+          if((d>=1&&pos[i+1]-pos[i]>1)||(d<=-1&&pos[i-1]-pos[i]<-1))
+            {
+              const double s=d>0?1:-1;
+              const double qp=q[i]+s/(pos[i+1]-pos[i-1])
+                *((pos[i]-pos[i-1]+s)*(q[i+1]-q[i])/(pos[i+1]-pos[i])
+                  +(pos[i+1]-pos[i]-s)*(q[i]-q[i-1])/(pos[i]-pos[i-1]));
+              if(q[i-1]<qp&&qp<q[i+1])
+                {
+                  q[i]=qp;
+                }
+              else
+                {
+                  const size_t j=s>0?i+1:i-1;
+                  q[i]+=s*(q[j]-q[i])/(pos[j]-pos[i]);
+                }
+              pos[i]+=s;
+            }
+        }
+    }
+
+    size_t size()const
+    {
+      return n;
+    }
+
+    //the p-quantile, at the position p*(n-1), as numpy.percentile; NaN
+    //if there is no value
+    double quantile(double p)const
+    {
+      if(n==0)
+        {
+          return std::numeric_limits<double>::quiet_NaN();
+        }
+      const double t=p*(n-1);
+      const size_t nm=q.size();
+      size_t j=0;
+      while(j+2<nm&&position(j+1)<=t)
+        {
+          ++j;
+        }
+      if(nm==1)
+        {
+          return q[0];
+        }
+      const double w=(t-position(j))/(position(j+1)-position(j));
+      return q[j]+std::min(std::max(w,0.),1.)*(q[j+1]-q[j]);
+    }
+  };
+
+  //the probabilities of the markers of the given number of equal cells
+  inline std::vector<double> p2_cells(size_t cells)
+  {
+    std::vector<double> p(cells+1);
+    for(size_t i=0;i<=cells;++i)
+      {
+        p[i]=double(i)/cells;
+      }
+    return p;
+  }
+
+  //the statistics at each radius of a profile (x, y) of the replicas,
+  //all on the same grid of x, if not to the same length
+  class profile_stat
+  {
+  private:
+    std::vector<double> quantiles;
+    std::vector<double> markers;
+    std::vector<double> x;
+    std::vector<running_stat> stat;
+    std::vector<p2_quantiles> quant;
+
+  public:
+    //with the quantiles p written, e.g., .1585, .5 and .8415, each
+    //estimated with the number of cells
+    explicit profile_stat(const std::vector<double>& p=std::vector<double>(),size_t cells=32)
+      :quantiles(p),markers(p2_cells(cells))
+    {}
+
+    //add the profile (x, y) of a replica; the values that are not
+    //finite are left out
+    void add(const std::vector<double>& xs,const std::vector<double>& ys)
+    {
+      for(size_t i=0;i<xs.size();++i)
+        {
+          if(i==x.size())
+            {
+              x.push_back(xs[i]);
+              stat.push_back(running_stat());
+              quant.push_back(p2_quantiles(markers));
+            }
+          if(std::abs(ys[i])<=std::numeric_limits<double>::max())
+            {
+              stat[i].add(ys[i]);
+              quant[i].add(ys[i]);
+            }
+        }
+    }
+
+    //a row at each radius: x, the number of values, their mean,
+    //standard deviation and quantiles
+    void write(std::ostream& os)const
+    {
+      for(size_t i=0;i<x.size();++i)
+        {
+          os<<x[i]<<"\t"<<stat[i].size()<<"\t"<<stat[i].mean()<<"\t"
+            <<std::sqrt(stat[i].variance());
+          for(size_t k=0;k<quantiles.size();++k)
+            {
+              os<<"\t"<<quant[i].quantile(quantiles[k]);
+            }
+          os<<"\n";
+        }
+    }
+  };
+
+  //the values of a scalar of the replicas, and its central value; the
+  //values are kept, as there is only one per replica
+  class scalar_stat
+  {
+  private:
+    double center;
+    std::vector<double> values;
+
+  public:
+    //the central value c
+    explicit scalar_stat(double c=0)
+      :center(c)
+    {}
+
+    void add(double v)
+    {
+      values.push_back(v);
+    }
+
+    double get_center()const
+    {
+      return center;
+    }
+
+    size_t size()const
+    {
+      return values.size();
+    }
+
+    //the smallest and the largest value, of at least one
+    double min()const
+    {
+      return *std::min_element(values.begin(),values.end());
+    }
+
+    double max()const
+    {
+      return *std::max_element(values.begin(),values.end());
+    }
+
+    //the interval of confidence level cl of analyze_mass_profile.py:
+    //with the values in order and the central value between those i and
+    //i+1, the values int(i*(1-cl)) and i-1+int((n-i)*cl); false if the
+    //central value is not enclosed by the values
+    bool interval(double cl,double& lower,double& upper)const
+    {
+      std::vector<double> s(values);
+      std::sort(s.begin(),s.end());
+      for(size_t i=0;i+1<s.size();++i)
+        {
+          if((center-s[i])*(center-s[i+1])<=0)
+            {
+              lower=s[size_t(i*(1-cl))];
+              upper=s[i-1+size_t((s.size()-i)*cl)];
+              return true;
+            }
+        }
+      return false;
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,303 @@
+#ifndef MC_PROFILE_HPP
+#define MC_PROFILE_HPP
+/*
+  In-memory steps of the Monte Carlo runs of the scripts
+
+  The Monte Carlo loops of bin/fit_mass.sh and bin/calc_lxfx.sh pass
+  their data between the tools through text files; these are the same
+  steps on data loaded once:
+    profile_data       a 4-column profile (x, xe, y, ye);
+    shuffle_profile()  draws y from the normal of sigma ye truncated to
+                       y>0, as bin/shuffle_profile.py (the bins with
+                       y<=0 or ye<=0 are kept as they are), by the
+                       counter_rng of (seed, replica, profile, bin,
+                       draw), so that a replica is the same whichever
+                       thread runs it, and can be drawn alone;
+    cfunc_table        interpolates a cooling function table (T, cf),
+                       linearly in log10(cf), as calc_coolfunc_profile.py;
+    fit_tprofile()     fits wang2012_model to a temperature profile, and
+                       dumps it, as fit_wang2012_model;
+    read_mass_cfg()    reads the keys of the mass.conf of the scripts;
+    parse_replicas()   reads the replicas to run, as a number or a range.
+  Everything here is reentrant, so that the replicas can run on
+  separate threads.
+*/
+
+#include "wang2012_model.hpp"
+#include <core/fitter.hpp>
+#include <core/freeze_param.hpp>
+#include <data_sets/default_data_set.hpp>
+#include <methods/powell/powell_method.hpp>
+#include "chisq.hpp"
+#include "multi_start.hpp"
+#include "counter_rng.hpp"
+#include <vector>
+#include <string>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <algorithm>
+
+namespace opt_utilities
+{
+  struct profile_data
+  {
+    std::vector<double> x,xe,y,ye;
+
+    size_t size()const
+    {
+      return x.size();
+    }
+  };
+
+  //read the 4-column profile of file; false if it cannot be opened
+  inline bool read_profile(const std::string& file,profile_data& d)
+  {
+    std::ifstream ifs(file.c_str());
+    if(!ifs.is_open())
+      {
+        return false;
+      }
+    d=profile_data();
+    std::string line;
+    while(std::getline(ifs,line))
+      {
+        std::istringstream iss(line);
+        double x,xe,y,ye;
+        if(iss>>x>>xe>>y>>ye)
+          {
+            d.x.push_back(x);
+            d.xe.push_back(xe);
+            d.y.push_back(y);
+            d.ye.push_back(ye);
+          }
+      }
+    return true;
+  }
+
+  //read the first value after each key of the mass.conf file; false if
+  //it cannot be opened
+  inline bool read_mass_cfg(const std::string& file,std::map<std::string,std::string>& cfg)
+  {
+    std::ifstream ifs(file.c_str());
+    if(!ifs.is_open())
+      {
+        return false;
+      }
+    cfg.clear();
+    std::string line;
+    while(std::getline(ifs,line))
+      {
+        std::istringstream iss(line);
+        std::string key,value;
+        if(iss>>key>>value)
+          {
+            cfg[key]=value;
+          }
+      }
+    return true;
+  }
+
+  //the profiles of a replica, in the counters of its random numbers
+  enum mc_profile_id
+    {
+      mc_tprofile=0,
+      mc_sbp=1
+    };
+
+  inline profile_data shuffle_profile(const profile_data& d,const counter_rng& rng,
+                                      size_t replica,mc_profile_id profile)
+  {
+    profile_data s(d);
+    for(size_t i=0;i<s.size();++i)
+      {
+        if(d.y[i]<=0||d.ye[i]<=0)
+          {
+            continue;
+          }
+        double v=-1;
+        for(uint32_t draw=0;v<=0;++draw)
+          {
+            v=rng.normal(uint32_t(replica),uint32_t(profile),uint32_t(i),draw)*d.ye[i]+d.y[i];
+          }
+        s.y[i]=v;
+      }
+    return s;
+  }
+
+  //the replicas of spec, "<n>" for No. 1 to n, or "<first>-<last>" (from
+  //No. 1), e.g., to run one of them again alone; false if malformed
+  inline bool parse_replicas(const std::string& spec,size_t& first,size_t& count)
+  {
+    std::istringstream iss(spec);
+    long a=0,b=0;
+    char dash=0;
+    if(!(iss>>a)||a<0)
+      {
+        return false;
+      }
+    if(!(iss>>dash))
+      {
+        first=0;
+        count=a;
+        return true;
+      }
+    if(dash!='-'||!(iss>>b)||a<1||b<a||(iss>>dash))
+      {
+        return false;
+      }
+    first=a-1;
+    count=b-a+1;
+    return true;
+  }
+
+  //A cooling function table, sorted by temperature
+  class cfunc_table
+  {
+  private:
+    std::vector<double> temp;
+    std::vector<double> log_cf;
+
+  public:
+    //read the 2-column table of file, skipping the comment lines of
+    //calc_coolfunc_table.py; false if it cannot be opened, or has fewer
+    //than 2 rows
+    bool load(const std::string& file)
+    {
+      std::ifstream ifs(file.c_str());
+      std::vector<std::pair<double,double> > rows;
+      std::string line;
+      while(std::getline(ifs,line))
+        {
+          std::istringstream iss(line);
+          double t,cf;
+          if(iss>>t>>cf)
+            {
+              rows.push_back(std::make_pair(t,std::log10(cf)));
+            }
+        }
+      std::sort(rows.begin(),rows.end());
+      temp.clear();
+      log_cf.clear();
+      for(size_t i=0;i<rows.size();++i)
+        {
+          temp.push_back(rows[i].first);
+          log_cf.push_back(rows[i].second);
+        }
+      return temp.size()>=2;
+    }
+
+    //the cooling function at temperature t; false outside the table,
+    //where the script fails too
+    bool eval(double t,double& cf)const
+    {
+      if(!(t>=temp.front()&&t<=temp.back()))
+        {
+          return false;
+        }
+      size_t i=std::upper_bound(temp.begin(),temp.end(),t)-temp.begin();
+      i=std::min(std::max(i,size_t(1)),temp.size()-1);
+      const double w=(t-temp[i-1])/(temp[i]-temp[i-1]);
+      cf=std::pow(10.,log_cf[i-1]+w*(log_cf[i]-log_cf[i-1]));
+      return true;
+    }
+  };
+
+  //A row of the parameter file of fit_wang2012_model
+  struct tprofile_param
+  {
+    std::string name;
+    double value;
+    double lower;
+    double upper;
+    bool frozen;
+  };
+
+  //read the parameter file (name, value, lower, upper, T|F); the values
+  //outside their limits are moved onto them, as by fit_wang2012_model
+  inline bool read_tprofile_params(const std::string& file,std::vector<tprofile_param>& params)
+  {
+    std::ifstream ifs(file.c_str());
+    if(!ifs.is_open())
+      {
+        return false;
+      }
+    params.clear();
+    for(;;)
+      {
+        tprofile_param p;
+        char status;
+        ifs>>p.name>>p.value>>p.lower>>p.upper>>status;
+        if(!ifs.good())
+          {
+            break;
+          }
+        p.frozen=status=='F';
+        p.value=std::min(std::max(p.value,p.lower),p.upper);
+        params.push_back(p);
+      }
+    return true;
+  }
+
+  //fit wang2012_model to t from params, from num_starts starting points
+  //each refitted up to 101 times, as fit_wang2012_model with its default
+  //method; the values of params are set to the solution, and the model
+  //is dumped at x=0, 10, ..., 2990 into xs and ts
+  inline void fit_tprofile(const profile_data& t,std::vector<tprofile_param>& params,
+                           size_t num_starts,std::vector<double>& xs,std::vector<double>& ts)
+  {
+    typedef fitter<double,double,std::vector<double>,double,std::string> tfitter;
+    tfitter fit;
+    default_data_set<double,double> ds;
+    for(size_t i=0;i<t.size();++i)
+      {
+        ds.add_data(data<double,double>(t.x[i],t.y[i],t.ye[i],t.ye[i],t.xe[i],t.xe[i]));
+      }
+    fit.load_data(ds);
+    fit.set_opt_method(powell_method<double,std::vector<double> >());
+    chisq<double,double,std::vector<double>,double,std::string> c;
+    c.set_limit();
+    fit.set_statistic(c);
+    //not memoized, unlike in fit_wang2012_model: on the few bins of a
+    //temperature profile, the model is cheaper than the cache lookups
+    fit.set_model(wang2012_model<double>());
+    std::vector<std::string> freeze_list;
+    for(size_t i=0;i<params.size();++i)
+      {
+        fit.set_param_value(params[i].name,params[i].value);
+        fit.set_param_lower_limit(params[i].name,params[i].lower);
+        fit.set_param_upper_limit(params[i].name,params[i].upper);
+        if(params[i].frozen)
+          {
+            freeze_list.push_back(params[i].name);
+          }
+      }
+    if(!freeze_list.empty())
+      {
+        freeze_param<double,double,std::vector<double>,std::string> fp(freeze_list[0]);
+        for(size_t i=1;i<freeze_list.size();++i)
+          {
+            fp=fp+freeze_param<double,double,std::vector<double>,std::string>(freeze_list[i]);
+          }
+        fit.set_param_modifier(fp);
+      }
+    multi_start<double,double,std::vector<double>,double,std::string> ms;
+    ms.set_num_starts(num_starts);
+    ms.set_max_refits(101);
+    const std::vector<double> p=ms.fit(fit);
+    for(size_t i=0;i<params.size();++i)
+      {
+        params[i].value=fit.get_param_value(params[i].name);
+      }
+    xs.clear();
+    ts.clear();
+    for(double x=0;x<3000;x+=10)
+      {
+        xs.push_back(x);
+        ts.push_back(fit.eval_model_raw(x,p));
+      }
+  }
+}
+
+#endif
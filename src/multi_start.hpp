@@ -0,0 +1,361 @@
+#ifndef MULTI_START_HPP
+#define MULTI_START_HPP
+/*
+  Multi-start fitting driver
+
+  Fits from several starting points at once (make OPENMP=1), on one
+  copy of the fitter per thread, whose parameters are reset for each
+  start, and keeps the solution of the lowest statistic; a single start
+  is fitted on the fitter itself.  The first start is the current parameters of the fitter;
+  the others are drawn inside the param_info limits by a Latin
+  hypercube, or as random perturbations of the current parameters.
+  The hypercube is log-uniform along the positive ranges spanning more
+  than a decade, and uniform along the others, but for those from zero
+  (or below) much wider than the current value, e.g., a2 of
+  wang2012_model in [0,1e8], whose draws would all be orders of
+  magnitude too large, and which are perturbed instead, as are the
+  parameters without finite limits.  The draws
+  are made on the parameters themselves, not on the space searched by
+  the optimizer, which the param_modifier (e.g., transform_param) may
+  have stretched to infinity; frozen parameters keep their values.
+  Each start is refitted until its statistic improves by less than the
+  tolerance (at most max_refits times, and within the evaluation and
+  time budgets of get_controller(); see fit_controller.hpp).  The starts run in rounds
+  of round_size (half of the starts by default); the driver stops once
+  a round has not improved the best statistic by the tolerance, the
+  first round being compared with its first start, i.e., the current
+  parameters.
+  The starting points are drawn from the seed before the fits, so the
+  result does not depend on the number of threads.
+*/
+
+#include <core/fitter.hpp>
+#include "parallel.hpp"
+#include "fit_controller.hpp"
+#include <vector>
+#include <string>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+namespace opt_utilities
+{
+  template <typename Ty,typename Tx,typename Tp,typename Ts,typename Tstr=std::string>
+  class multi_start
+  {
+  public:
+    enum start_mode
+      {
+        latin_hypercube,
+        perturbed
+      };
+  private:
+    typedef typename element_type_trait<Tp>::element_type Tv;
+    size_t num_starts;
+    size_t round_size;
+    fit_controller<Ty,Tx,Tp,Ts,Tstr> controller;
+    Ts tolerance;
+    Tv spread;
+    start_mode mode;
+    unsigned long long state;
+    size_t starts_run;
+    size_t num_evals;
+    size_t best_start;
+    Ts best_stat;
+
+  public:
+    multi_start()
+      :num_starts(8),round_size(0),tolerance(1e-4),spread(.5),
+       mode(latin_hypercube),state(1),starts_run(0),num_evals(0),best_start(0),
+       best_stat(0)
+    {
+      controller.set_max_fits(1);
+    }
+
+    //total number of starts, including the current parameters
+    void set_num_starts(size_t n)
+    {
+      num_starts=std::max(n,size_t(1));
+    }
+
+    //number of starts fitted before the improvement is checked; 0 for
+    //half of the starts
+    void set_round_size(size_t n)
+    {
+      round_size=n;
+    }
+
+    //maximum number of fit() calls of each start
+    void set_max_refits(size_t n)
+    {
+      controller.set_max_fits(n);
+    }
+
+    //the controller of the fits of each start, e.g., for the budgets
+    fit_controller<Ty,Tx,Tp,Ts,Tstr>& get_controller()
+    {
+      return controller;
+    }
+
+    //relative improvement of the statistic below which a start, and the
+    //whole driver, stop
+    void set_tolerance(Ts t)
+    {
+      tolerance=t;
+      controller.set_tolerance(t);
+    }
+
+    //relative size of the perturbations
+    void set_spread(Tv s)
+    {
+      spread=s;
+    }
+
+    void set_mode(start_mode m)
+    {
+      mode=m;
+    }
+
+    void set_seed(unsigned long long s)
+    {
+      state=s;
+    }
+
+    //number of starts fitted by the last fit()
+    size_t get_starts_run()const
+    {
+      return starts_run;
+    }
+
+    //number of statistic evaluations of the last fit(), over all starts
+    size_t get_num_evals()const
+    {
+      return num_evals;
+    }
+
+    //index of the start of the best solution, 0 for the current parameters
+    size_t get_best_start()const
+    {
+      return best_start;
+    }
+
+    Ts get_best_statistic()const
+    {
+      return best_stat;
+    }
+
+  private:
+    //one copy of the fitter per thread, made on the first start of the
+    //thread and reused for the others
+    class fitter_pool
+    {
+    private:
+      const fitter<Ty,Tx,Tp,Ts,Tstr>& f;
+      std::vector<fitter<Ty,Tx,Tp,Ts,Tstr>*> copies;
+      fitter_pool(const fitter_pool&);
+      fitter_pool& operator=(const fitter_pool&);
+    public:
+      explicit fitter_pool(const fitter<Ty,Tx,Tp,Ts,Tstr>& f0)
+        :f(f0)
+      {
+#ifdef _OPENMP
+        copies.assign(omp_get_max_threads(),NULL_PTR);
+#else
+        copies.assign(1,NULL_PTR);
+#endif
+      }
+
+      ~fitter_pool()
+      {
+        for(size_t i=0;i<copies.size();++i)
+          {
+            delete copies[i];
+          }
+      }
+
+      fitter<Ty,Tx,Tp,Ts,Tstr>& get()
+      {
+        size_t t=0;
+#ifdef _OPENMP
+        t=omp_get_thread_num();
+#endif
+        if(copies[t]==NULL_PTR)
+          {
+            copies[t]=new fitter<Ty,Tx,Tp,Ts,Tstr>(f);
+          }
+        return *copies[t];
+      }
+    };
+
+    //uniform in [0,1), by splitmix64
+    Tv uniform()
+    {
+      unsigned long long z=(state+=0x9e3779b97f4a7c15ULL);
+      z=(z^(z>>30))*0xbf58476d1ce4e5b9ULL;
+      z=(z^(z>>27))*0x94d049bb133111ebULL;
+      z^=z>>31;
+      return Tv(z>>11)*(Tv(1)/Tv(1ULL<<53));
+    }
+
+    static bool bounded(Tv lo,Tv up)
+    {
+      const Tv huge=1e30;
+      return lo>-huge&&up<huge&&lo<up;
+    }
+
+    //the limits span more than a decade
+    static bool log_range(Tv lo,Tv up)
+    {
+      return lo>0&&up>10*lo;
+    }
+
+    //the limits reach down to zero (or below), but span much more than
+    //the current value x
+    static bool wide_range(Tv x,Tv lo,Tv up)
+    {
+      return lo<=0&&x!=0&&up-lo>10*std::abs(x);
+    }
+
+    //the starting points, each within the limits
+    void draw_starts(const Tp& x0,const Tp& lo,const Tp& up,std::vector<Tp>& starts)
+    {
+      const size_t np=x0.size();
+      const size_t m=num_starts-1;
+      starts.assign(num_starts,x0);
+      std::vector<size_t> strata(m);
+      for(size_t j=0;j<np;++j)
+        {
+          //a random permutation of the strata of this parameter
+          for(size_t k=0;k<m;++k)
+            {
+              strata[k]=k;
+            }
+          for(size_t k=m;k>1;--k)
+            {
+              std::swap(strata[k-1],strata[size_t(uniform()*k)]);
+            }
+          for(size_t k=0;k<m;++k)
+            {
+              Tv& x=starts[k+1][j];
+              if(mode==latin_hypercube&&bounded(lo[j],up[j])&&
+                 !wide_range(x0[j],lo[j],up[j]))
+                {
+                  const Tv t=(strata[k]+uniform())/m;
+                  if(log_range(lo[j],up[j]))
+                    {
+                      x=lo[j]*std::exp(t*std::log(up[j]/lo[j]));
+                      x=std::min(std::max(x,lo[j]),up[j]);
+                    }
+                  else
+                    {
+                      x=lo[j]+t*(up[j]-lo[j]);
+                    }
+                }
+              else
+                {
+                  x=x0[j]*(1+spread*(2*uniform()-1));
+                  x=std::min(std::max(x,lo[j]),up[j]);
+                }
+            }
+        }
+    }
+
+    //fit from the (full) parameters full, which replace all of those of
+    //g, refitting until it stops improving
+    Ts fit_one(fitter<Ty,Tx,Tp,Ts,Tstr>& g,const Tp& full,size_t& nevals)const
+    {
+      for(size_t i=0;i<full.size();++i)
+        {
+          g.set_param_value(g.get_param_info(i).get_name(),full[i]);
+        }
+      fit_controller<Ty,Tx,Tp,Ts,Tstr> c(controller);
+      c.fit(g);
+      nevals=c.get_num_evals();
+      return g.get_statistic_value();
+    }
+
+  public:
+    //fit f from num_starts points, and leave it at the best solution,
+    //whose (full) parameters are returned
+    Tp fit(fitter<Ty,Tx,Tp,Ts,Tstr>& f)
+    {
+      model<Ty,Tx,Tp,Tstr>& mdl=f.get_model();
+      const Tp full0=f.get_all_params();
+      Tp lf(full0.size()),uf(full0.size());
+      for(size_t i=0;i<full0.size();++i)
+        {
+          lf[i]=f.get_param_info(i).get_lower_limit();
+          uf[i]=f.get_param_info(i).get_upper_limit();
+        }
+      //the starts are drawn in the space of the parameters, and taken
+      //through the param_modifier, which restores the frozen ones and
+      //maps them into the space searched by the optimizer
+      std::vector<Tp> starts;
+      draw_starts(full0,lf,uf,starts);
+      for(size_t k=1;k<num_starts;++k)
+        {
+          starts[k]=mdl.reform_param(mdl.deform_param(starts[k]));
+        }
+
+      std::vector<Ts> stat(num_starts,std::numeric_limits<Ts>::max());
+      std::vector<Tp> result(num_starts,full0);
+      std::vector<size_t> evals(num_starts,0);
+      best_start=0;
+      best_stat=std::numeric_limits<Ts>::max();
+      starts_run=0;
+      num_evals=0;
+      const size_t rs=round_size>0?round_size:std::max(num_starts/2,size_t(1));
+      fitter_pool pool(f);
+      while(starts_run<num_starts)
+        {
+          const size_t k0=starts_run;
+          const size_t k1=std::min(num_starts,k0+rs);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+          for(int k=(int)k0;k<(int)k1;++k)
+            {
+              fitter<Ty,Tx,Tp,Ts,Tstr>& g=num_starts>1?pool.get():f;
+              try
+                {
+                  stat[k]=fit_one(g,starts[k],evals[k]);
+                  result[k]=g.get_all_params();
+                }
+              catch(const opt_exception&)
+                {
+                  //a failed start is ignored
+                }
+            }
+          starts_run=k1;
+          for(size_t k=k0;k<k1;++k)
+            {
+              num_evals+=evals[k];
+            }
+          //the best of the round, the earlier start on a tie; the first
+          //round is compared with the current parameters
+          const Ts prev_best=k0>0?best_stat:stat[0];
+          for(size_t k=k0;k<k1;++k)
+            {
+              if(stat[k]<best_stat)
+                {
+                  best_stat=stat[k];
+                  best_start=k;
+                }
+            }
+          if((k0>0||k1>1)&&!(prev_best-best_stat>tolerance*std::abs(best_stat)))
+            {
+              break;
+            }
+        }
+
+      const Tp& best=result[best_start];
+      for(size_t i=0;i<best.size();++i)
+        {
+          f.set_param_value(f.get_param_info(i).get_name(),best[i]);
+        }
+      return best;
+    }
+  };
+}
+
+#endif
@@ -9,13 +9,16 @@
 #define NFW
 #define OPT_HEADER
 #include <core/fitter.hpp>
+#include "param_derivative.hpp"
+#include "dual.hpp"
 #include <cmath>
 
 namespace opt_utilities
 {
   template <typename T>
   class nfw
-    :public model<T,T,std::vector<T>,std::string>
+    :public model<T,T,std::vector<T>,std::string>,
+     public param_derivative<T,T,std::vector<T> >
   {
   private:
     model<T,T,std::vector<T> >* do_clone()const
@@ -36,10 +39,26 @@ namespace opt_utilities
 
     T do_eval(const T& r,const std::vector<T>& param)
     {
-      T rho0=std::abs(param[0]);
-      T rs=std::abs(param[1]);
+      using std::abs;
+      using std::log;
+      T rho0=abs(param[0]);
+      T rs=abs(param[1]);
       static const T pi=4*std::atan(1);
-      return 4*pi*rho0*rs*rs*rs*(std::log((r+rs)/rs)-r/(r+rs));
+      return 4*pi*rho0*rs*rs*rs*(log((r+rs)/rs)-r/(r+rs));
+    }
+
+    bool do_eval_derivative(const T& r,const std::vector<T>& param,std::vector<T>& dy)
+    {
+      using std::abs;
+      using std::log;
+      T rho0=abs(param[0]);
+      T rs=abs(param[1]);
+      static const T pi=4*std::atan(1);
+      T g=log((r+rs)/rs)-r/(r+rs);
+      dy.resize(2);
+      dy[0]=(param[0]<0?-1:1)*4*pi*rs*rs*rs*g;
+      dy[1]=(param[1]<0?-1:1)*4*pi*rho0*rs*rs*(3*g-r*r/((r+rs)*(r+rs)));
+      return true;
     }
 
   private:
@@ -0,0 +1,287 @@
+#ifndef PACKED_TRI_HPP
+#define PACKED_TRI_HPP
+/*
+  Packed upper-triangular matrix used as the projection operator
+
+  Row i keeps the columns [i0, npad), where i0 is i rounded down to a
+  multiple of packed_tri_block and npad is n rounded up to it.  Every row
+  therefore starts on a cache line, and lines up with a vector of npad
+  elements that is aligned the same way.  The padding elements are zero.
+
+  row_dot_sq() computes sum_j a(i,j)*u[j]^2 in a single pass,
+  with an AVX-512 or AVX2 kernel when the compiler targets them (e.g.,
+  make NATIVE=1), otherwise with a scalar loop.  row_dot() is the plain
+  sum_j a(i,j)*u[j], used for the parameter derivatives.  row_sum_sq()
+  takes the vector of load_sq(): with the AVX kernels, the density
+  itself, squared in the pass; otherwise its squares, computed once
+  instead of in every row, and summed by row_dot().
+*/
+
+#include <vector>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+//number of elements of a row block, a 64-byte cache line of doubles
+static const size_t packed_tri_block=8;
+static const size_t packed_tri_align=64;
+
+//allocator returning cache-line aligned storage
+template <typename T>
+class aligned_allocator
+{
+public:
+  typedef T value_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+
+  template <typename U>
+  struct rebind
+  {
+    typedef aligned_allocator<U> other;
+  };
+
+  aligned_allocator()
+  {}
+
+  template <typename U>
+  aligned_allocator(const aligned_allocator<U>&)
+  {}
+
+  pointer address(reference x)const
+  {
+    return &x;
+  }
+
+  const_pointer address(const_reference x)const
+  {
+    return &x;
+  }
+
+  pointer allocate(size_type n,const void* =0)
+  {
+    void* p=0;
+    if(n==0)
+      {
+        return 0;
+      }
+    if(posix_memalign(&p,packed_tri_align,n*sizeof(T))!=0)
+      {
+        throw std::bad_alloc();
+      }
+    return static_cast<pointer>(p);
+  }
+
+  void deallocate(pointer p,size_type)
+  {
+    free(p);
+  }
+
+  size_type max_size()const
+  {
+    return size_type(-1)/sizeof(T);
+  }
+
+  void construct(pointer p,const T& x)
+  {
+    new(p) T(x);
+  }
+
+  void destroy(pointer p)
+  {
+    p->~T();
+  }
+};
+
+template <typename T,typename U>
+bool operator==(const aligned_allocator<T>&,const aligned_allocator<U>&)
+{
+  return true;
+}
+
+template <typename T,typename U>
+bool operator!=(const aligned_allocator<T>&,const aligned_allocator<U>&)
+{
+  return false;
+}
+
+//the row_dot_sq() kernel of T squares u in the pass, faster than
+//reading the squares (AVX)
+template <typename T>
+struct packed_tri_fused_sq
+{
+  static const bool value=false;
+};
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+template <>
+struct packed_tri_fused_sq<double>
+{
+  static const bool value=true;
+};
+#endif
+
+//sum_j a[j]*u[j]^2, len is a multiple of packed_tri_block
+template <typename T>
+inline T packed_tri_dot_sq(const T* a,const T* u,size_t len)
+{
+  T sum=0;
+  for(size_t j=0;j<len;++j)
+    {
+      sum+=a[j]*(u[j]*u[j]);
+    }
+  return sum;
+}
+
+//sum_j a[j]*u[j]
+template <typename T>
+inline T packed_tri_dot(const T* a,const T* u,size_t len)
+{
+  T sum=0;
+  for(size_t j=0;j<len;++j)
+    {
+      sum+=a[j]*u[j];
+    }
+  return sum;
+}
+
+#if defined(__AVX512F__)
+inline double packed_tri_dot_sq(const double* a,const double* u,size_t len)
+{
+  __m512d acc=_mm512_setzero_pd();
+  for(size_t j=0;j<len;j+=8)
+    {
+      __m512d x=_mm512_load_pd(u+j);
+      acc=_mm512_fmadd_pd(_mm512_load_pd(a+j),_mm512_mul_pd(x,x),acc);
+    }
+  double lane[8];
+  _mm512_storeu_pd(lane,acc);
+  return ((lane[0]+lane[4])+(lane[1]+lane[5]))+((lane[2]+lane[6])+(lane[3]+lane[7]));
+}
+#elif defined(__AVX2__)
+inline double packed_tri_dot_sq(const double* a,const double* u,size_t len)
+{
+  __m256d acc0=_mm256_setzero_pd();
+  __m256d acc1=_mm256_setzero_pd();
+  for(size_t j=0;j<len;j+=8)
+    {
+      __m256d x0=_mm256_load_pd(u+j);
+      __m256d x1=_mm256_load_pd(u+j+4);
+#ifdef __FMA__
+      acc0=_mm256_fmadd_pd(_mm256_load_pd(a+j),_mm256_mul_pd(x0,x0),acc0);
+      acc1=_mm256_fmadd_pd(_mm256_load_pd(a+j+4),_mm256_mul_pd(x1,x1),acc1);
+#else
+      acc0=_mm256_add_pd(acc0,_mm256_mul_pd(_mm256_load_pd(a+j),_mm256_mul_pd(x0,x0)));
+      acc1=_mm256_add_pd(acc1,_mm256_mul_pd(_mm256_load_pd(a+j+4),_mm256_mul_pd(x1,x1)));
+#endif
+    }
+  __m256d acc=_mm256_add_pd(acc0,acc1);
+  __m128d s=_mm_add_pd(_mm256_castpd256_pd128(acc),_mm256_extractf128_pd(acc,1));
+  return _mm_cvtsd_f64(_mm_add_sd(s,_mm_unpackhi_pd(s,s)));
+}
+#endif
+
+template <typename T>
+class packed_tri
+{
+public:
+  typedef std::vector<T,aligned_allocator<T> > vector_type;
+private:
+  size_t n;
+  size_t npad;
+  std::vector<size_t> offset;
+  vector_type data;
+
+public:
+  packed_tri()
+    :n(0),npad(0)
+  {}
+
+  //set the size, and zero all the elements
+  void resize(size_t n1)
+  {
+    n=n1;
+    npad=(n+packed_tri_block-1)/packed_tri_block*packed_tri_block;
+    offset.resize(n);
+    size_t off=0;
+    for(size_t i=0;i<n;++i)
+      {
+        offset[i]=off;
+        off+=npad-first_col(i);
+      }
+    data.assign(off,T(0));
+  }
+
+  size_t size()const
+  {
+    return n;
+  }
+
+  //length of the (zero padded) vectors passed to row_dot_sq()
+  size_t padded_size()const
+  {
+    return npad;
+  }
+
+  //first stored column of row i
+  size_t first_col(size_t i)const
+  {
+    return i/packed_tri_block*packed_tri_block;
+  }
+
+  //element (i,j), j>=i
+  T& operator()(size_t i,size_t j)
+  {
+    return data[offset[i]+j-first_col(i)];
+  }
+
+  const T& operator()(size_t i,size_t j)const
+  {
+    return data[offset[i]+j-first_col(i)];
+  }
+
+  //sum_j a(i,j)*u[j]^2 for row i; u must be aligned, and hold
+  //padded_size() elements with zeros after the first n
+  T row_dot_sq(size_t i,const T* u)const
+  {
+    const size_t j0=first_col(i);
+    return packed_tri_dot_sq(&data[offset[i]],u+j0,npad-j0);
+  }
+
+  //sum_j a(i,j)*u[j] for row i, with the same u as row_dot_sq(); the
+  //padding is left out
+  T row_dot(size_t i,const T* u)const
+  {
+    const size_t j0=first_col(i);
+    return packed_tri_dot(&data[offset[i]],u+j0,n-j0);
+  }
+
+  //fill u (padded_size() elements, aligned) for row_sum_sq() from the
+  //n elements of ne
+  void load_sq(const T* ne,T* u)const
+  {
+    for(size_t j=0;j<n;++j)
+      {
+        u[j]=packed_tri_fused_sq<T>::value?ne[j]:ne[j]*ne[j];
+      }
+    for(size_t j=n;j<npad;++j)
+      {
+        u[j]=T(0);
+      }
+  }
+
+  //sum_j a(i,j)*ne[j]^2 for row i, with u from load_sq()
+  T row_sum_sq(size_t i,const T* u)const
+  {
+    return packed_tri_fused_sq<T>::value?row_dot_sq(i,u):row_dot(i,u);
+  }
+};
+
+#endif
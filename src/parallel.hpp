@@ -0,0 +1,42 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+/*
+  Settings shared by the OpenMP-parallel loops (make OPENMP=1)
+
+  Loops over fewer than omp_min_bins() bins run serially, so that short
+  profiles don't pay the threading overhead.  Sums are reduced over
+  fixed-size blocks whose partial sums are added in order, so the
+  results don't depend on the number of threads.
+*/
+
+#include <cstddef>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+//default bin-count threshold of the parallel loops
+#ifndef OMP_MIN_BINS
+#define OMP_MIN_BINS 256
+#endif
+
+//block size of the deterministic reductions
+static const size_t omp_reduce_block=64;
+
+inline size_t& omp_min_bins_ref()
+{
+  static size_t n=OMP_MIN_BINS;
+  return n;
+}
+
+//bin-count threshold above which the loops run in parallel
+inline size_t omp_min_bins()
+{
+  return omp_min_bins_ref();
+}
+
+inline void set_omp_min_bins(size_t n)
+{
+  omp_min_bins_ref()=n;
+}
+
+#endif
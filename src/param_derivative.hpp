@@ -0,0 +1,170 @@
+#ifndef PARAM_DERIVATIVE_HPP
+#define PARAM_DERIVATIVE_HPP
+/*
+  Interface of the models that provide the derivatives of their output
+  with respect to their parameters in closed form, e.g., beta, dbeta,
+  nfw, wang2012_model, and the projector, which propagates those of the
+  model it projects.  Callers go through eval_model_derivative(), which
+  also carries the derivatives through the param_modifier of the model:
+  exactly for freeze_param and for the modifiers that provide
+  reform_derivative (e.g., transform_param), by forward differences of
+  reform_param() for any other.
+*/
+
+#include <core/fitter.hpp>
+#include <core/freeze_param.hpp>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+namespace opt_utilities
+{
+  template <typename Ty,typename Tx,typename Tp>
+  class param_derivative
+  {
+  public:
+    virtual ~param_derivative()
+    {}
+
+    //dy[j]=d(do_eval(x,p))/dp[j] for each parameter j; p has already
+    //been reformed; false if the derivatives are not available
+    virtual bool do_eval_derivative(const Tx& x,const Tp& p,std::vector<Ty>& dy)=0;
+  };
+
+  //Interface of the param_modifiers whose reformed parameters each
+  //depend on at most one free parameter: p[index[j]]=f_j(u[j]) for the
+  //No. j free parameter, with df[j]=f_j'(u[j]); the others are fixed
+  template <typename Tp>
+  class reform_derivative
+  {
+  public:
+    virtual ~reform_derivative()
+    {}
+
+    virtual void do_reform_derivative(const Tp& u,std::vector<size_t>& index,Tp& df)const=0;
+  };
+
+  //the param_modifier of m, or NULL_PTR if it has none; found through
+  //get_param_modifier(), which throws on a model without one, so the
+  //callers look it up once per Jacobian rather than once per point
+  template <typename Ty,typename Tx,typename Tp,typename Tstr>
+  inline const param_modifier<Ty,Tx,Tp,Tstr>* find_param_modifier(model<Ty,Tx,Tp,Tstr>& m)
+  {
+    try
+      {
+        return &m.get_param_modifier();
+      }
+    catch(const opt_exception&)
+      {
+        return NULL_PTR;
+      }
+  }
+
+  //y+=c*x for the scalar and the vector valued models
+  template <typename T>
+  inline void derivative_add_scaled(T& y,const T& c,const T& x)
+  {
+    y+=c*x;
+  }
+
+  template <typename T>
+  inline void derivative_add_scaled(std::vector<T>& y,const T& c,const std::vector<T>& x)
+  {
+    y.resize(x.size(),T(0));
+    for(size_t i=0;i<x.size();++i)
+      {
+        y[i]+=c*x[i];
+      }
+  }
+
+  //dy[j]=d(m.eval(x,p))/dp[j] for each (free) parameter j, with pm the
+  //param_modifier of m as found by find_param_modifier(); false if the
+  //model does not provide its derivatives
+  template <typename Ty,typename Tx,typename Tp,typename Tstr>
+  bool eval_model_derivative(model<Ty,Tx,Tp,Tstr>& m,const param_modifier<Ty,Tx,Tp,Tstr>* pm,
+                             const Tx& x,const Tp& p,std::vector<Ty>& dy)
+  {
+    typedef typename element_type_trait<Tp>::element_type Tv;
+    param_derivative<Ty,Tx,Tp>* pd=dynamic_cast<param_derivative<Ty,Tx,Tp>*>(&m);
+    if(!pd)
+      {
+        return false;
+      }
+    const Tp full(m.reform_param(p));
+    std::vector<Ty> dfull;
+    if(!pd->do_eval_derivative(x,full,dfull))
+      {
+        return false;
+      }
+    const size_t nfull=std::min(full.size(),dfull.size());
+    dy.assign(p.size(),Ty());
+    if(!pm)
+      {
+        for(size_t j=0;j<p.size()&&j<nfull;++j)
+          {
+            dy[j]=dfull[j];
+          }
+        return true;
+      }
+    //chain rule through the param_modifier
+    std::vector<size_t> index;
+    Tp df;
+    const reform_derivative<Tp>* prd=dynamic_cast<const reform_derivative<Tp>*>(pm);
+    if(prd)
+      {
+        prd->do_reform_derivative(p,index,df);
+      }
+    else if(dynamic_cast<const freeze_param<Ty,Tx,Tp,Tstr>*>(pm))
+      {
+        //the thawed parameters are copied, in order
+        for(size_t i=0;i<m.get_num_params();++i)
+          {
+            const Tstr status=m.report_param_status(m.get_param_info(i).get_name());
+            if(status==Tstr()||status==Tstr("thawed"))
+              {
+                index.push_back(i);
+              }
+          }
+        df.assign(index.size(),Tv(1));
+      }
+    else
+      {
+        //any other modifier: forward differences of the reformed
+        //parameters, exact only for those that copy the free parameters,
+        //at the cost of a reform_param() per free parameter
+        const Tv eps=std::sqrt(std::numeric_limits<Tv>::epsilon());
+        Tp p1(p);
+        for(size_t j=0;j<p.size();++j)
+          {
+            p1[j]=p[j]+eps*std::max(std::abs(p[j]),Tv(1));
+            const Tv dp=p1[j]-p[j];
+            const Tp full1(m.reform_param(p1));
+            for(size_t k=0;k<nfull;++k)
+              {
+                derivative_add_scaled(dy[j],Tv((full1[k]-full[k])/dp),dfull[k]);
+              }
+            p1[j]=p[j];
+          }
+        return true;
+      }
+    for(size_t j=0;j<p.size()&&j<index.size();++j)
+      {
+        if(index[j]<nfull)
+          {
+            derivative_add_scaled(dy[j],df[j],dfull[index[j]]);
+          }
+      }
+    return true;
+  }
+
+  //the same for a single point, looking up the param_modifier of m
+  template <typename Ty,typename Tx,typename Tp,typename Tstr>
+  bool eval_model_derivative(model<Ty,Tx,Tp,Tstr>& m,const Tx& x,const Tp& p,
+                             std::vector<Ty>& dy)
+  {
+    return eval_model_derivative(m,find_param_modifier(m),x,p,dy);
+  }
+}
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef PROGRESS_REPORTER_HPP
+#define PROGRESS_REPORTER_HPP
+/*
+  Progress reporter of the fit statistics
+
+  Counts the evaluations, and allows a report at most once per interval
+  (in seconds).  Only compiled in with PROGRESS_REPORT defined
+  (make PROGRESS=1); otherwise tick() is a constant false, and the
+  reporting code is removed by the compiler.
+*/
+
+#include <iostream>
+#include <cstddef>
+#include <ctime>
+
+class progress_reporter
+{
+#ifdef PROGRESS_REPORT
+private:
+  size_t count;
+  std::time_t interval;
+  std::time_t last;
+public:
+  progress_reporter(std::time_t dt=1)
+    :count(0),interval(dt),last(std::time(0))
+  {}
+
+  //count an evaluation, returning true if a report is due
+  bool tick()
+  {
+    ++count;
+    std::time_t now=std::time(0);
+    if(now-last<interval)
+      {
+	return false;
+      }
+    last=now;
+    return true;
+  }
+
+  size_t get_count()const
+  {
+    return count;
+  }
+#else
+public:
+  progress_reporter(std::time_t =1)
+  {}
+
+  bool tick()
+  {
+    return false;
+  }
+
+  size_t get_count()const
+  {
+    return 0;
+  }
+#endif
+
+public:
+  //print the evaluation count, the statistic and the parameters
+  template <typename Ts,typename Tp>
+  void report(std::ostream& os,const Ts& stat,const Tp& p)const
+  {
+    os<<get_count()<<"\t"<<stat<<"\t";
+    for(size_t i=0;i<p.size();++i)
+      {
+	os<<p[i]<<",";
+      }
+    os<<std::endl;
+  }
+};
+
+#endif
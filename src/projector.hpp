@@ -8,8 +8,16 @@
 
 
 #include <core/fitter.hpp>
+#include "dual.hpp"
+#include "abel_tree.hpp"
+#include "parallel.hpp"
+#include "packed_tri.hpp"
+#include "batch_func.hpp"
+#include "fused_model.hpp"
+#include "param_derivative.hpp"
 #include <vector>
 #include <cmath>
+#include <algorithm>
 
 static const double pi=4*atan(1);
 // Ratio of the electron density (n_e) to the proton density (n_p)
@@ -22,52 +30,84 @@ namespace opt_utilities
   //This is used to project a 3-D surface brightness model to 2-D profile
   template <typename T>
   class projector
-    :public model<std::vector<T>,std::vector<T>,std::vector<T> >
+    :public model<std::vector<T>,std::vector<T>,std::vector<T> >,
+     public fused_model<std::vector<T>,std::vector<T>,std::vector<T> >,
+     public batch_model<std::vector<T>,std::vector<T>,std::vector<T> >,
+     public param_derivative<std::vector<T>,std::vector<T>,std::vector<T> >
   {
   private:
     //Points to a 3-D model that is to be projected
     model<std::vector<T>,std::vector<T>,std::vector<T> >* pmodel;
     func_obj<T,T>* pcfunc;
     T cm_per_pixel;
+    //Cached projection volumes (in cm^3), which depend only on the
+    //radius grid and cm_per_pixel, stored as a (n-1)x(n-1) row-major
+    //matrix indexed by [nrad][nsph], together with the annulus areas
+    std::vector<T> vol_rlist;
+    std::vector<T> vol_matrix;
+    std::vector<T> area_list;
+    bool vol_valid;
+    size_t vol_cache_hits;
+    size_t vol_cache_rebuilds;
+    //Per-shell emissivity weight, i.e., cfunc/ne_np_ratio
+    std::vector<T> weight_list;
+    bool weight_valid;
+    //Emissivity-weighted projection operator, i.e., the volume matrix
+    //folded with cfunc/ne_np_ratio per shell and 1/area per annulus;
+    //rebuilt on a new grid, attach_cfunc() or set_cm_per_pixel()
+    packed_tri<T> op_matrix;
+    bool op_valid;
+    //unprojected density, and its zero padded, aligned copy
+    std::vector<T> unprojected;
+    typename packed_tri<T>::vector_type ne_buffer;
+    //densities (emissivities with the fast engine) of the batched
+    //evaluation
+    typename packed_tri<T>::vector_type batch_ne;
+    std::vector<T> batch_emis;
+    //derivatives of the unprojected density
+    std::vector<std::vector<T> > deriv_ne;
+    //Grids with at least this many bins are projected with the
+    //O(N log N) engine instead of the cached O(N^2) volume matrix
+    size_t fast_threshold;
+    abel_tree<T> fast_engine;
+    std::vector<T> fast_result;
+    //Projected source profile of the last evaluation, keyed on the grid
+    //and the parameters other than the additive ones (bkg by default),
+    //which are added to the cached profile in O(N)
+    std::vector<size_t> additive_params;
+    std::vector<T> src_key;
+    std::vector<T> src_key_buf;
+    std::vector<T> src_profile;
+    bool src_valid;
+    size_t src_cache_hits;
+    //parameters of the model (without bkg) of the constraint checks
+    mutable std::vector<T> model_param_buf;
   public:
     //default cstr
     projector()
-      :pmodel(NULL_PTR),pcfunc(NULL_PTR),cm_per_pixel(1)
+      :pmodel(NULL_PTR),pcfunc(NULL_PTR),cm_per_pixel(1),
+       vol_valid(false),vol_cache_hits(0),vol_cache_rebuilds(0),
+       weight_valid(false),op_valid(false),fast_threshold(1000),
+       src_valid(false),src_cache_hits(0)
     {}
-    //copy cstr
+    //copy cstr; the parameter infos (and modifier) are copied by the
+    //base class, and the caches are kept warm
     projector(const projector& rhs)
-      :model<std::vector<T>,std::vector<T>,std::vector<T> >(rhs)
+      :model<std::vector<T>,std::vector<T>,std::vector<T> >(rhs),
+       pmodel(NULL_PTR),pcfunc(NULL_PTR)
     {
-      cm_per_pixel=rhs.cm_per_pixel;
-      attach_model(*(rhs.pmodel));
-      if(rhs.pcfunc)
-        {
-          pcfunc=rhs.pcfunc->clone();
-        }
-      else
-        {
-          pcfunc=NULL_PTR;
-        }
+      copy_from(rhs);
     }
     //assign operator
     projector& operator=(const projector& rhs)
     {
-      if(pmodel)
-        {
-          pmodel->destroy();
-        }
-      if(pcfunc)
-        {
-          pcfunc->destroy();
-        }
-      if(rhs.pcfunc)
+      if(this==&rhs)
         {
-          pcfunc=rhs.pcfunc->clone();
-        }
-      if(rhs.pmodel)
-        {
-          pmodel=rhs.pmodel->clone();
+          return *this;
         }
+      model<std::vector<T>,std::vector<T>,std::vector<T> >::operator=(rhs);
+      copy_from(rhs);
+      return *this;
     }
     //destr
     ~projector()
@@ -88,10 +128,105 @@ namespace opt_utilities
       return new projector(*this);
     }
 
+  private:
+    //take the attached model, cooling function and caches of rhs
+    void copy_from(const projector& rhs)
+    {
+      if(pmodel)
+        {
+          pmodel->destroy();
+        }
+      if(pcfunc)
+        {
+          pcfunc->destroy();
+        }
+      pmodel=rhs.pmodel?rhs.pmodel->clone():NULL_PTR;
+      pcfunc=rhs.pcfunc?rhs.pcfunc->clone():NULL_PTR;
+      cm_per_pixel=rhs.cm_per_pixel;
+      vol_rlist=rhs.vol_rlist;
+      vol_matrix=rhs.vol_matrix;
+      area_list=rhs.area_list;
+      vol_valid=rhs.vol_valid;
+      vol_cache_hits=rhs.vol_cache_hits;
+      vol_cache_rebuilds=rhs.vol_cache_rebuilds;
+      weight_list=rhs.weight_list;
+      weight_valid=rhs.weight_valid;
+      op_matrix=rhs.op_matrix;
+      op_valid=rhs.op_valid;
+      fast_threshold=rhs.fast_threshold;
+      fast_engine=rhs.fast_engine;
+      additive_params=rhs.additive_params;
+      src_key=rhs.src_key;
+      src_profile=rhs.src_profile;
+      src_valid=rhs.src_valid;
+      src_cache_hits=rhs.src_cache_hits;
+    }
+
   public:
     void set_cm_per_pixel(const T& x)
     {
       cm_per_pixel=x;
+      //the cached volumes are in cm^3, so force a rebuild
+      vol_rlist.clear();
+    }
+
+    //grids with at least n bins are projected with the fast engine
+    void set_fast_threshold(size_t n)
+    {
+      fast_threshold=n;
+      src_valid=false;
+    }
+
+    size_t get_fast_threshold()const
+    {
+      return fast_threshold;
+    }
+
+    //relative error bound of the fast engine
+    void set_fast_tolerance(const T& tol)
+    {
+      fast_engine.set_tolerance(tol);
+      src_valid=false;
+    }
+
+    T get_fast_tolerance()const
+    {
+      return fast_engine.get_tolerance();
+    }
+
+    //number of evaluations that reused the cached radius grid
+    size_t get_cache_hits()const
+    {
+      return vol_cache_hits;
+    }
+
+    //number of times the volume matrix has been (re)built
+    size_t get_cache_rebuilds()const
+    {
+      return vol_cache_rebuilds;
+    }
+
+    //number of evaluations served from the cached source profile, i.e.,
+    //where only the additive parameters had changed
+    size_t get_source_cache_hits()const
+    {
+      return src_cache_hits;
+    }
+
+    //parameters whose absolute values are added to every projected bin;
+    //only bkg by default
+    void set_additive_params(const std::vector<std::string>& names)
+    {
+      additive_params.clear();
+      for(size_t i=0;i<this->get_num_params();++i)
+        {
+          if(std::find(names.begin(),names.end(),
+                       this->get_param_info(i).get_name())!=names.end())
+            {
+              additive_params.push_back(i);
+            }
+        }
+      src_valid=false;
     }
 
     //attach the model that is to be projected
@@ -104,8 +239,14 @@ namespace opt_utilities
         }
       this -> push_param_info(param_info<std::vector<T>,
                               std::string>("bkg",0,0,1E99));
+      if(pmodel)
+        {
+          pmodel->destroy();
+        }
       pmodel=m.clone();
       pmodel->clear_param_modifier();
+      additive_params.assign(1,this->get_num_params()-1);
+      src_valid=false;
     }
 
     void attach_cfunc(const func_obj<T,T>& cf)
@@ -115,6 +256,9 @@ namespace opt_utilities
           pcfunc->destroy();
         }
       pcfunc=cf.clone();
+      weight_valid=false;
+      op_valid=false;
+      src_valid=false;
     }
 
   public:
@@ -132,8 +276,9 @@ namespace opt_utilities
     {
       if(rcyc<rsph)
         {
-          double a=rsph*rsph-rcyc*rcyc;
-          return 4.*pi/3.*std::sqrt(a*a*a);
+          using std::sqrt;
+          T a=rsph*rsph-rcyc*rcyc;
+          return 4.*pi/3.*sqrt(a*a*a);
         }
       return 0;
     }
@@ -156,56 +301,461 @@ namespace opt_utilities
                 calc_v_ring(rlist[nsph], rlist[nrad+1]));
       }
     }
-  public:
-    bool do_meets_constraint(const std::vector<T>& p)const
+
+    //reset the cached data if the radius grid has changed
+    void update_grid(const std::vector<T>& rlist)
     {
-      std::vector<T> p1(this->reform_param(p));
-      for(size_t i=0;i!=p1.size();++i)
+      if(!vol_rlist.empty() && vol_rlist==rlist)
+        {
+          ++vol_cache_hits;
+          return;
+        }
+      const size_t n=rlist.size()-1;
+      area_list.resize(n);
+      for(size_t nrad=0; nrad<n; ++nrad)
         {
-          if(get_element(p1,i)>this->get_param_info(i).get_upper_limit()||
-            get_element(p1,i)<this->get_param_info(i).get_lower_limit())
+          area_list[nrad] = pi * (rlist[nrad+1]*rlist[nrad+1] -
+                                  rlist[nrad]*rlist[nrad]);
+        }
+      vol_rlist=rlist;
+      vol_valid=false;
+      weight_valid=false;
+      op_valid=false;
+      src_valid=false;
+    }
+
+    //(re)build the volume matrix if the radius grid has changed
+    void update_volume(const std::vector<T>& rlist)
+    {
+      update_grid(rlist);
+      if(vol_valid)
+        {
+          return;
+        }
+      const size_t n=rlist.size()-1;
+      const T cm3=pow(cm_per_pixel, 3);
+      vol_matrix.assign(n*n, 0);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,16) if(n>=omp_min_bins())
+#endif
+      for(int nrad=0; nrad<(int)n; ++nrad)
+        {
+          for(size_t nsph=nrad; nsph<n; ++nsph)
             {
-              // std::cerr<<this->get_param_info(i).get_name()<<"\t"<<p1[i]<<std::endl;
-              return false;
+              vol_matrix[nrad*n+nsph] = calc_v(rlist, nsph, nrad) * cm3;
             }
         }
-      std::vector<T> p2(p1.size()-1);
-      for(size_t i=0;i<p1.size()-1;++i)
+      vol_valid=true;
+      ++vol_cache_rebuilds;
+    }
+
+    //sample a cooling function at the middle of each shell, in a
+    //single call if it supports batch evaluation
+    void sample_cfunc(func_obj<T,T>& cf,const std::vector<T>& rlist,
+                      std::vector<T>& result)
+    {
+      const size_t n=rlist.size()-1;
+      result.resize(n);
+      batch_func<T>* pb=dynamic_cast<batch_func<T>*>(&cf);
+      if(pb)
+        {
+          std::vector<T> rmid(n);
+          for(size_t nsph=0; nsph<n; ++nsph)
+            {
+              rmid[nsph] = (rlist[nsph+1] + rlist[nsph]) / 2.0;
+            }
+          pb->eval_batch(&rmid[0], &result[0], n);
+          return;
+        }
+      for(size_t nsph=0; nsph<n; ++nsph)
+        {
+          result[nsph] = cf((rlist[nsph+1] + rlist[nsph]) / 2.0);
+        }
+    }
+
+    //(re)compute the per-shell emissivity weight
+    void update_weight(const std::vector<T>& rlist)
+    {
+      if(weight_valid)
+        {
+          return;
+        }
+      const size_t n=rlist.size()-1;
+      weight_list.assign(n, 1);
+      if(pcfunc)
         {
-          p2.at(i)=p1[i];
+          sample_cfunc(*pcfunc, rlist, weight_list);
+          for(size_t nsph=0; nsph<n; ++nsph)
+            {
+              weight_list[nsph] /= ne_np_ratio;
+            }
         }
+      weight_valid=true;
+    }
 
-      return pmodel->meets_constraint(p2);
+    //(re)build the emissivity-weighted operator if it is out of date
+    void update_operator(const std::vector<T>& rlist)
+    {
+      update_volume(rlist);
+      if(op_valid)
+        {
+          return;
+        }
+      update_weight(rlist);
+      const size_t n=rlist.size()-1;
+      op_matrix.resize(n);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,16) if(n>=omp_min_bins())
+#endif
+      for(int nrad=0; nrad<(int)n; ++nrad)
+        {
+          for(size_t nsph=nrad; nsph<n; ++nsph)
+            {
+              op_matrix(nrad, nsph) = vol_matrix[nrad*n+nsph] *
+                weight_list[nsph] / area_list[nrad];
+            }
+        }
+      op_valid=true;
+    }
+  public:
+    //on the reformed parameters, the only copy of them
+    bool do_meets_constraint(const std::vector<T>& p0)const
+    {
+      const std::vector<T> p(this->reform_param(p0));
+      for(size_t i=0;i!=p.size();++i)
+        {
+          if(get_element(p,i)>this->get_param_info(i).get_upper_limit()||
+            get_element(p,i)<this->get_param_info(i).get_lower_limit())
+            {
+              return false;
+            }
+        }
+      //the parameters of the model are those but the last (bkg), in a
+      //buffer kept between the calls
+      model_param_buf.assign(p.begin(),p.end()-1);
+      return pmodel->meets_constraint(model_param_buf);
     }
   public:
     //Perform the projection
     std::vector<T> do_eval(const std::vector<T>& x,const std::vector<T>& p)
     {
-      T bkg=std::abs(p.back());
+      std::vector<T> projected;
+      do_eval_into(x,p,projected);
+      return projected;
+    }
+
+    //Perform the projection into a buffer of the caller
+    void do_eval_into(const std::vector<T>& x,const std::vector<T>& p,
+                      std::vector<T>& projected)
+    {
+      using std::abs;
+      const size_t n=x.size()-1;
+      T offset=0;
+      src_key_buf=p;
+      for(size_t i=0;i<additive_params.size();++i)
+        {
+          offset+=abs(p[additive_params[i]]);
+          src_key_buf[additive_params[i]]=0;
+        }
+      //keyed on the tangents too, on dual numbers
+      if(src_valid && identical(src_key,src_key_buf) && vol_rlist==x)
+        {
+          ++src_cache_hits;
+        }
+      else
+        {
+          project_source(x,p);
+          src_key.swap(src_key_buf);
+          src_valid=true;
+        }
+      projected.resize(n);
+      for(size_t nrad=0; nrad<n; ++nrad)
+        {
+          projected[nrad] = src_profile[nrad] + offset;
+        }
+    }
+
+  private:
+    //project the source (i.e., without the additive parameters)
+    void project_source(const std::vector<T>& x,const std::vector<T>& p)
+    {
       //I think following codes are clear enough :).
-      std::vector<T> unprojected(pmodel->eval(x,p));
-      std::vector<T> projected(unprojected.size());
+      eval_model_into(*pmodel,x,p,unprojected);
+      const size_t n=x.size()-1;
+      src_profile.resize(n);
 
-      for(size_t nrad=0; nrad<x.size()-1; ++nrad)
+      if(n>=fast_threshold)
         {
-          for(size_t nsph=nrad; nsph<x.size()-1; ++nsph)
+          update_grid(x);
+          update_weight(x);
+          const T cm3=pow(cm_per_pixel, 3);
+          for(size_t nsph=0; nsph<n; ++nsph)
             {
-              double v = calc_v(x, nsph, nrad) * pow(cm_per_pixel, 3);
-              if(pcfunc)
+              unprojected[nsph] *= unprojected[nsph] * weight_list[nsph] * cm3;
+            }
+          fast_engine.project(x, unprojected, 1, fast_result);
+          for(size_t nrad=0; nrad<n; ++nrad)
+            {
+              src_profile[nrad] = fast_result[nrad] / area_list[nrad];
+            }
+          return;
+        }
+
+      update_operator(x);
+      //the density is squared once, or inside the AVX kernels
+      ne_buffer.resize(op_matrix.padded_size());
+      op_matrix.load_sq(&unprojected[0], &ne_buffer[0]);
+      //each row is summed in order by one thread
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,16) if(n>=omp_min_bins())
+#endif
+      for(int nrad=0; nrad<(int)n; ++nrad)
+        {
+          src_profile[nrad] = op_matrix.row_sum_sq(nrad, &ne_buffer[0]);
+        }
+    }
+
+  public:
+    //Perform the projection for many parameter vectors; each row of the
+    //operator is applied to all of the density profiles while it is in
+    //the cache, i.e., as a matrix-matrix product
+    void do_eval_batch(const std::vector<T>& x,
+                       const std::vector<std::vector<T> >& ps,
+                       std::vector<std::vector<T> >& projected)
+    {
+      using std::abs;
+      const size_t n=x.size()-1;
+      const size_t m=ps.size();
+      const bool fast=n>=fast_threshold;
+      projected.resize(m);
+      std::vector<T> offset(m, 0);
+      for(size_t k=0; k<m; ++k)
+        {
+          projected[k].resize(n);
+          for(size_t i=0; i<additive_params.size(); ++i)
+            {
+              offset[k] += abs(ps[k][additive_params[i]]);
+            }
+        }
+
+      if(fast)
+        {
+          update_grid(x);
+          update_weight(x);
+          const T cm3=pow(cm_per_pixel, 3);
+          //emissivity of each shell for each parameter vector, [nsph][k]
+          batch_emis.resize(n*m);
+          for(size_t k=0; k<m; ++k)
+            {
+              eval_model_into(*pmodel,x,ps[k],unprojected);
+              for(size_t nsph=0; nsph<n; ++nsph)
                 {
-                  double cfunc = (*pcfunc)((x[nsph+1] + x[nsph]) / 2.0);
-                  projected[nrad] += (unprojected[nsph] * unprojected[nsph] *
-                                      cfunc * v / ne_np_ratio);
+                  batch_emis[nsph*m+k] = unprojected[nsph] * unprojected[nsph] *
+                    weight_list[nsph] * cm3;
                 }
-              else
+            }
+          fast_engine.project(x, batch_emis, m, fast_result);
+          for(size_t nrad=0; nrad<n; ++nrad)
+            {
+              for(size_t k=0; k<m; ++k)
                 {
-                  projected[nrad] += unprojected[nsph] * unprojected[nsph] * v;
+                  projected[k][nrad] = fast_result[nrad*m+k] /
+                    area_list[nrad] + offset[k];
                 }
             }
-          double area = pi * (x[nrad+1]*x[nrad+1] - x[nrad]*x[nrad]);
-          projected[nrad] /= area;
-          projected[nrad] += bkg;
+          return;
         }
+
+      update_operator(x);
+      //zero padded density of each parameter vector, one after another
+      const size_t npad=op_matrix.padded_size();
+      batch_ne.resize(m*npad);
+      for(size_t k=0; k<m; ++k)
+        {
+          eval_model_into(*pmodel,x,ps[k],unprojected);
+          op_matrix.load_sq(&unprojected[0], &batch_ne[k*npad]);
+        }
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,16) if(n>=omp_min_bins())
+#endif
+      for(int nrad=0; nrad<(int)n; ++nrad)
+        {
+          for(size_t k=0; k<m; ++k)
+            {
+              projected[k][nrad] = op_matrix.row_sum_sq(nrad, &batch_ne[k*npad]) +
+                offset[k];
+            }
+        }
+    }
+
+  public:
+    //Derivatives of the projected profile: those of the density model
+    //go through the same operator as d(ne^2)/dp=2*ne*dne/dp, and the
+    //additive parameters add their sign to every bin; false if the
+    //density model has no derivatives
+    bool do_eval_derivative(const std::vector<T>& x,const std::vector<T>& p,
+                            std::vector<std::vector<T> >& dy)
+    {
+      param_derivative<std::vector<T>,std::vector<T>,std::vector<T> >* pd=
+        dynamic_cast<param_derivative<std::vector<T>,std::vector<T>,std::vector<T> >*>(pmodel);
+      if(!pd || !pd->do_eval_derivative(x,p,deriv_ne))
+        {
+          return false;
+        }
+      eval_model_into(*pmodel,x,p,unprojected);
+      const size_t n=x.size()-1;
+      const size_t np=p.size();
+      const size_t nsrc=std::min(deriv_ne.size(), np);
+      dy.resize(np);
+      for(size_t j=0; j<np; ++j)
+        {
+          dy[j].assign(n, 0);
+        }
+
+      if(nsrc>0 && n>=fast_threshold)
+        {
+          update_grid(x);
+          update_weight(x);
+          const T cm3=pow(cm_per_pixel, 3);
+          //the projection is linear, so the derivatives of the emissivity
+          //are projected as the bands of a single sweep, [nsph][j]
+          batch_emis.resize(n*nsrc);
+          for(size_t nsph=0; nsph<n; ++nsph)
+            {
+              const T w=2 * unprojected[nsph] * weight_list[nsph] * cm3;
+              for(size_t j=0; j<nsrc; ++j)
+                {
+                  batch_emis[nsph*nsrc+j] = w * deriv_ne[j][nsph];
+                }
+            }
+          fast_engine.project(x, batch_emis, nsrc, fast_result);
+          for(size_t nrad=0; nrad<n; ++nrad)
+            {
+              for(size_t j=0; j<nsrc; ++j)
+                {
+                  dy[j][nrad] = fast_result[nrad*nsrc+j] / area_list[nrad];
+                }
+            }
+        }
+      else if(nsrc>0)
+        {
+          update_operator(x);
+          const size_t npad=op_matrix.padded_size();
+          batch_ne.assign(nsrc*npad, 0);
+          for(size_t j=0; j<nsrc; ++j)
+            {
+              for(size_t nsph=0; nsph<n; ++nsph)
+                {
+                  batch_ne[j*npad+nsph] = 2 * unprojected[nsph] * deriv_ne[j][nsph];
+                }
+            }
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,16) if(n>=omp_min_bins())
+#endif
+          for(int nrad=0; nrad<(int)n; ++nrad)
+            {
+              for(size_t j=0; j<nsrc; ++j)
+                {
+                  dy[j][nrad] = op_matrix.row_dot(nrad, &batch_ne[j*npad]);
+                }
+            }
+        }
+
+      for(size_t i=0; i<additive_params.size(); ++i)
+        {
+          const size_t a=additive_params[i];
+          const T s=p[a]<0?-1:1;
+          for(size_t nrad=0; nrad<n; ++nrad)
+            {
+              dy[a][nrad] += s;
+            }
+        }
+      return true;
+    }
+
+  public:
+    //Perform the projection for several cooling functions (e.g., the
+    //energy bands of Lx/Fx) in a single sweep over the volume matrix,
+    //returning one projected profile per cooling function
+    std::vector<std::vector<T> >
+    eval_cfuncs(const std::vector<T>& x,const std::vector<T>& p,
+                const std::vector<func_obj<T,T>*>& cfuncs)
+    {
+      using std::abs;
+      T bkg=abs(p.back());
+      std::vector<T> unprojected(pmodel->eval(x,p));
+      const size_t n=x.size()-1;
+      const size_t nband=cfuncs.size();
+      const bool fast=n>=fast_threshold;
+      if(fast)
+        {
+          update_grid(x);
+        }
+      else
+        {
+          update_volume(x);
+        }
+
+      //emissivity of each shell in each band, stored as [nsph][band]
+      std::vector<T> emis(n*nband);
+      std::vector<T> cf;
+      for(size_t k=0; k<nband; ++k)
+        {
+          sample_cfunc(*cfuncs[k], x, cf);
+          for(size_t nsph=0; nsph<n; ++nsph)
+            {
+              T ne2=unprojected[nsph] * unprojected[nsph];
+              emis[nsph*nband+k] = ne2 * cf[nsph] / ne_np_ratio;
+            }
+        }
+
+      std::vector<std::vector<T> > projected(nband, std::vector<T>(n));
+      if(fast)
+        {
+          const T cm3=pow(cm_per_pixel, 3);
+          for(size_t i=0; i<emis.size(); ++i)
+            {
+              emis[i] *= cm3;
+            }
+          fast_engine.project(x, emis, nband, fast_result);
+          for(size_t nrad=0; nrad<n; ++nrad)
+            {
+              for(size_t k=0; k<nband; ++k)
+                {
+                  projected[k][nrad] = fast_result[nrad*nband+k] /
+                    area_list[nrad] + bkg;
+                }
+            }
+          return projected;
+        }
+
+#ifdef _OPENMP
+#pragma omp parallel if(n>=omp_min_bins())
+#endif
+      {
+        std::vector<T> sum(nband);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic,16)
+#endif
+        for(int nrad=0; nrad<(int)n; ++nrad)
+          {
+            const T* vrow=&vol_matrix[nrad*n];
+            std::fill(sum.begin(), sum.end(), T(0));
+            for(size_t nsph=nrad; nsph<n; ++nsph)
+              {
+                const T v=vrow[nsph];
+                const T* e=&emis[nsph*nband];
+                for(size_t k=0; k<nband; ++k)
+                  {
+                    sum[k] += v * e[k];
+                  }
+              }
+            for(size_t k=0; k<nband; ++k)
+              {
+                projected[k][nrad] = sum[k] / area_list[nrad] + bkg;
+              }
+          }
+      }
       return projected;
     }
   };
@@ -0,0 +1,33 @@
+#ifndef RESIDUAL_FUNC_HPP
+#define RESIDUAL_FUNC_HPP
+/*
+  Interface of the statistics that are a sum of squared residuals, e.g.,
+  chisq and vchisq, which lets the least-squares methods (lm_method)
+  see the residuals themselves instead of only their sum.
+*/
+
+#include <vector>
+
+namespace opt_utilities
+{
+  template <typename T>
+  class residual_func
+  {
+  public:
+    virtual ~residual_func()
+    {}
+
+    //r[i]=(y_model-y_obs)/sigma of each bin at p, so that the statistic
+    //is sum_i r[i]^2; false if p violates the limits of the statistic
+    virtual bool eval_residuals(const std::vector<T>& p,std::vector<T>& r)=0;
+
+    //jac[i*p.size()+j]=dr[i]/dp[j] at p; false if there is no analytic
+    //Jacobian, in which case the callers use finite differences
+    virtual bool eval_jacobian(const std::vector<T>& /*p*/,std::vector<T>& /*jac*/)
+    {
+      return false;
+    }
+  };
+}
+
+#endif
@@ -6,6 +6,7 @@
 #include <cassert>
 #include <cmath>
 #include <limits>
+#include <algorithm>
 
 template <typename T>
 class spline
@@ -15,7 +16,20 @@ public:
   std::vector<T> y_list;
   std::vector<T> y2_list;
 
+private:
+  //set by gen_spline() if the knots are uniformly spaced, in which case
+  //the interval is found by direct indexing
+  bool uniform;
+  T inv_dx;
+  //cubic coefficients of each interval in t=x-x_list[i], i.e.,
+  //y=c0+t*(c1+t*(c2+t*c3)), with a constant last entry for x>=x_list.back()
+  std::vector<T> c0_list,c1_list,c2_list,c3_list;
+
 public:
+  spline()
+    :uniform(false),inv_dx(0)
+  {}
+
   void push_point(T x,T y)
   {
     if(!x_list.empty())
@@ -26,7 +40,15 @@ public:
     y_list.push_back(y);
   }
 
-  T get_value(T x)
+  T get_value(T x)const
+  {
+    size_t hint=0;
+    return get_value(x,hint);
+  }
+
+  //hint is the index of the interval found by the last call, so that a
+  //monotone sweep over x finds its interval in O(1)
+  T get_value(T x,size_t& hint)const
   {
     if(x<=x_list[0])
       {
@@ -39,32 +61,109 @@ public:
     assert(x_list.size()==y2_list.size());
     assert(x>x_list[0]);
     assert(x<x_list.back());
-    int n1,n2;
-    n1=0;
-    n2=x_list.size()-1;
-    while((n2-n1)!=1)
+    size_t n1=find_interval(x,hint);
+    size_t n2=n1+1;
+    hint=n1;
+    T h=x_list[n2]-x_list[n1];
+    double a=(x_list[n2]-x)/h;
+    double b=(x-x_list[n1])/h;
+    return a*y_list[n1]+b*y_list[n2]+((a*a*a-a)*y2_list[n1]+
+				      (b*b*b-b)*y2_list[n2])*(h*h)/6.;
+
+  }
+
+  //evaluate n points at once; x must be sorted in ascending order
+  //(the results agree with get_value() to rounding)
+  void get_values(const T* x,T* y,size_t n)const
+  {
+    assert(c0_list.size()==x_list.size());
+    const size_t nk=x_list.size();
+    const size_t block=256;
+    size_t idx[block];
+    T t[block];
+    size_t hint=0;
+    for(size_t i0=0;i0<n;i0+=block)
       {
-	//cerr<<n1<<"\t"<<n2<<endl;
-	if(x_list[n1+1]<=x)
+	const size_t m=std::min(block,n-i0);
+	//locate the intervals
+	for(size_t i=0;i<m;++i)
 	  {
-	    n1++;
+	    const T xi=x[i0+i];
+	    if(xi<=x_list[0])
+	      {
+		idx[i]=0;
+		t[i]=0;
+	      }
+	    else if(xi>=x_list.back())
+	      {
+		idx[i]=nk-1;
+		t[i]=0;
+	      }
+	    else
+	      {
+		hint=find_interval(xi,hint);
+		idx[i]=hint;
+		t[i]=xi-x_list[hint];
+	      }
 	  }
-	if(x_list[n2-1]>x)
+	//evaluate the polynomials
+	const T* c0=&c0_list[0];
+	const T* c1=&c1_list[0];
+	const T* c2=&c2_list[0];
+	const T* c3=&c3_list[0];
+	T* yb=y+i0;
+	for(size_t i=0;i<m;++i)
 	  {
-	    n2--;
+	    const size_t k=idx[i];
+	    yb[i]=c0[k]+t[i]*(c1[k]+t[i]*(c2[k]+t[i]*c3[k]));
 	  }
       }
-    T h=x_list[n2]-x_list[n1];
-    double a=(x_list[n2]-x)/h;
-    double b=(x-x_list[n1])/h;
-    return a*y_list[n1]+b*y_list[n2]+((a*a*a-a)*y2_list[n1]+
-				      (b*b*b-b)*y2_list[n2])*(h*h)/6.;
+  }
 
+private:
+  //the n1 with x_list[n1]<=x<x_list[n1+1], for x_list[0]<x<x_list.back()
+  size_t find_interval(T x,size_t hint)const
+  {
+    const size_t n=x_list.size();
+    if(hint+1<n && x_list[hint]<=x)
+      {
+	if(x<x_list[hint+1])
+	  {
+	    return hint;
+	  }
+	if(hint+2<n && x<x_list[hint+2])
+	  {
+	    return hint+1;
+	  }
+      }
+    if(uniform)
+      {
+	//the guess is corrected, so rounding can't pick a wrong interval
+	size_t n1=std::min(size_t((x-x_list[0])*inv_dx),n-2);
+	while(n1>0 && x_list[n1]>x)
+	  {
+	    --n1;
+	  }
+	while(x_list[n1+1]<=x)
+	  {
+	    ++n1;
+	  }
+	return n1;
+      }
+    return std::upper_bound(x_list.begin(),x_list.end(),x)-x_list.begin()-1;
   }
 
+public:
   void gen_spline(T y2_0,T y2_N)
   {
     int n=x_list.size();
+    T dx=(x_list[n-1]-x_list[0])/(n-1);
+    uniform=n>2;
+    for(int i=1;i<n && uniform;++i)
+      {
+	uniform=std::abs(x_list[i]-x_list[0]-i*dx)<=1e-6*dx;
+      }
+    inv_dx=1/dx;
     y2_list.resize(0);
     y2_list.resize(x_list.size());
     std::vector<T> u(x_list.size());
@@ -103,6 +202,21 @@ public:
       {
 	y2_list[i]=y2_list[i]*y2_list[i+1]+u[i];
       }
+
+    c0_list.resize(n);
+    c1_list.resize(n);
+    c2_list.resize(n);
+    c3_list.resize(n);
+    for(int i=0;i<n-1;++i)
+      {
+	T h=x_list[i+1]-x_list[i];
+	c0_list[i]=y_list[i];
+	c1_list[i]=(y_list[i+1]-y_list[i])/h-h*(2*y2_list[i]+y2_list[i+1])/6.;
+	c2_list[i]=y2_list[i]/2.;
+	c3_list[i]=(y2_list[i+1]-y2_list[i])/(6.*h);
+      }
+    c0_list[n-1]=y_list[n-1];
+    c1_list[n-1]=c2_list[n-1]=c3_list[n-1]=0;
   }
 
 };
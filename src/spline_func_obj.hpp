@@ -0,0 +1,48 @@
+#ifndef SPLINE_FUNC_OBJ_HPP
+#define SPLINE_FUNC_OBJ_HPP
+
+#include <core/fitter.hpp>
+#include "spline.hpp"
+#include "batch_func.hpp"
+
+//A class enclosing the spline interpolation method
+class spline_func_obj
+  :public opt_utilities::func_obj<double,double>,
+   public opt_utilities::batch_func<double>
+{
+  //has an spline object
+  spline<double> spl;
+public:
+  //This function is used to calculate the intepolated value
+  double do_eval(const double& x)
+  {
+    return spl.get_value(x);
+  }
+
+  //we need this function, when this object is performing a clone of itself
+  spline_func_obj* do_clone()const
+  {
+    return new spline_func_obj(*this);
+  }
+
+public:
+  //add points to the spline object, after which the spline will be initialized
+  void add_point(double x,double y)
+  {
+    spl.push_point(x,y);
+  }
+
+  //before getting the intepolated value, the spline should be initialzied by calling this function
+  void gen_spline()
+  {
+    spl.gen_spline(0,0);
+  }
+
+  //calculate the intepolated values of many sorted points at once
+  void eval_batch(const double* x,double* y,size_t n)const
+  {
+    spl.get_values(x,y,n);
+  }
+};
+
+#endif
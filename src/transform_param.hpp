@@ -0,0 +1,246 @@
+#ifndef TRANSFORM_PARAM_HPP
+#define TRANSFORM_PARAM_HPP
+/*
+  Parameter transform modifier
+
+  Maps the unconstrained space searched by the optimizer onto the limits
+  of each parameter, so that no statistic evaluation falls outside them
+  and the 1e99 walls of the set_limit() statistics are never hit:
+    logistic  p=lo+(up-lo)/(1+exp(-u)), for the parameters with both
+              limits finite (e.g., beta);
+    log       p=lo+exp(u), for those with only the lower one (e.g., n0,
+              rc), which then move by factors instead of steps;
+    identity  p=u, otherwise.
+  The kinds are chosen from the limits at each call (auto), unless set
+  with set_transform().  Parameters can also be frozen, as by
+  freeze_param, since a model has only one param_modifier.  Limits of
+  1e30 or more in magnitude count as infinite.  The derivatives of the
+  transforms are given to eval_model_derivative() in closed form.
+  Both transforms map the limits to infinity: a start on a limit (e.g.,
+  bkg=0 under [0,1e99]) is moved off it to u=log(eps), far for the
+  optimizer to come back from, and a best value on one (e.g., beta at
+  1.4) is only approached.  On the test double-beta profile this left
+  Powell in a worse minimum than with the walls, so the SBP tools do not
+  use it.
+*/
+
+#include <core/fitter.hpp>
+#include "param_derivative.hpp"
+#include <vector>
+#include <string>
+#include <set>
+#include <map>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+namespace opt_utilities
+{
+  template <typename Ty,typename Tx,typename Tp,typename Tstr=std::string>
+  class transform_param
+    :public param_modifier<Ty,Tx,Tp,Tstr>,
+     public reform_derivative<Tp>
+  {
+  public:
+    enum transform_kind
+      {
+        auto_transform,
+        identity_transform,
+        log_transform,
+        logistic_transform
+      };
+  private:
+    typedef typename element_type_trait<Tp>::element_type Tv;
+    std::map<Tstr,transform_kind> kind_names;
+    std::set<Tstr> frozen_names;
+    //the kind of each parameter, and whether it is frozen, by order
+    std::vector<transform_kind> kinds;
+    std::vector<char> frozen;
+    size_t num_frozen;
+
+  public:
+    transform_param()
+      :num_frozen(0)
+    {}
+
+    //the transform of a parameter, auto by default
+    void set_transform(const Tstr& name,transform_kind k)
+    {
+      kind_names[name]=k;
+    }
+
+    //hold a parameter at its current value
+    void freeze(const Tstr& name)
+    {
+      frozen_names.insert(name);
+    }
+
+  private:
+    transform_param* do_clone()const
+    {
+      return new transform_param(*this);
+    }
+
+    //resolve the names, when attached to a model
+    void update()
+    {
+      const model<Ty,Tx,Tp,Tstr>& m=this->get_model();
+      const size_t n=m.get_num_params();
+      kinds.assign(n,auto_transform);
+      frozen.assign(n,0);
+      num_frozen=0;
+      for(typename std::map<Tstr,transform_kind>::const_iterator i=kind_names.begin();
+          i!=kind_names.end();++i)
+        {
+          kinds[m.get_param_order(i->first)]=i->second;
+        }
+      for(typename std::set<Tstr>::const_iterator i=frozen_names.begin();
+          i!=frozen_names.end();++i)
+        {
+          frozen[m.get_param_order(*i)]=1;
+          ++num_frozen;
+        }
+    }
+
+    static bool finite(Tv x)
+    {
+      return std::abs(x)<Tv(1e30);
+    }
+
+    //the kind of the No. i parameter under its current limits
+    transform_kind kind_of(size_t i,Tv lo,Tv up)const
+    {
+      if(kinds[i]!=auto_transform)
+        {
+          return kinds[i];
+        }
+      if(finite(lo)&&finite(up)&&lo<up)
+        {
+          return logistic_transform;
+        }
+      if(finite(lo))
+        {
+          return log_transform;
+        }
+      return identity_transform;
+    }
+
+    Tp do_reform(const Tp& u)const
+    {
+      const model<Ty,Tx,Tp,Tstr>& m=this->get_model();
+      const size_t n=m.get_num_params();
+      Tp p(n);
+      for(size_t i=0,j=0;i<n;++i)
+        {
+          const param_info<Tp,Tstr>& pi=m.get_param_info(i);
+          if(frozen[i])
+            {
+              p[i]=pi.get_value();
+              continue;
+            }
+          const Tv lo=pi.get_lower_limit();
+          const Tv up=pi.get_upper_limit();
+          const Tv x=u[j++];
+          switch(kind_of(i,lo,up))
+            {
+            case logistic_transform:
+              p[i]=lo+(up-lo)/(1+std::exp(-x));
+              break;
+            case log_transform:
+              p[i]=lo+std::exp(x);
+              break;
+            default:
+              p[i]=x;
+            }
+        }
+      return p;
+    }
+
+    Tp do_deform(const Tp& p)const
+    {
+      const model<Ty,Tx,Tp,Tstr>& m=this->get_model();
+      const Tv eps=std::numeric_limits<Tv>::epsilon();
+      Tp u;
+      u.reserve(p.size()-num_frozen);
+      for(size_t i=0;i<p.size();++i)
+        {
+          if(frozen[i])
+            {
+              continue;
+            }
+          const param_info<Tp,Tstr>& pi=m.get_param_info(i);
+          const Tv lo=pi.get_lower_limit();
+          const Tv up=pi.get_upper_limit();
+          switch(kind_of(i,lo,up))
+            {
+            case logistic_transform:
+              {
+                //kept off the limits, which map to infinity
+                const Tv t=std::min(std::max((p[i]-lo)/(up-lo),eps),1-eps);
+                u.push_back(std::log(t/(1-t)));
+                break;
+              }
+            case log_transform:
+              u.push_back(std::log(std::max(p[i]-lo,eps*std::max(std::abs(p[i]),Tv(1)))));
+              break;
+            default:
+              u.push_back(p[i]);
+            }
+        }
+      return u;
+    }
+
+  public:
+    //the reformed parameter of each free one, and its derivative
+    void do_reform_derivative(const Tp& u,std::vector<size_t>& index,Tp& df)const
+    {
+      const model<Ty,Tx,Tp,Tstr>& m=this->get_model();
+      const size_t n=m.get_num_params();
+      index.clear();
+      df.clear();
+      for(size_t i=0,j=0;i<n;++i)
+        {
+          if(frozen[i])
+            {
+              continue;
+            }
+          const param_info<Tp,Tstr>& pi=m.get_param_info(i);
+          const Tv lo=pi.get_lower_limit();
+          const Tv up=pi.get_upper_limit();
+          const Tv x=u[j++];
+          index.push_back(i);
+          switch(kind_of(i,lo,up))
+            {
+            case logistic_transform:
+              {
+                const Tv s=1/(1+std::exp(-x));
+                df.push_back((up-lo)*s*(1-s));
+                break;
+              }
+            case log_transform:
+              df.push_back(std::exp(x));
+              break;
+            default:
+              df.push_back(1);
+            }
+        }
+    }
+
+  private:
+    size_t do_get_num_free_params()const
+    {
+      return this->get_model().get_num_params()-num_frozen;
+    }
+
+    Tstr do_report_param_status(const Tstr& name)const
+    {
+      if(frozen_names.count(name))
+        {
+          return Tstr("frozen");
+        }
+      return Tstr("thawed");
+    }
+  };
+}
+
+#endif
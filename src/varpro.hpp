@@ -0,0 +1,389 @@
+#ifndef VARPRO_HPP
+#define VARPRO_HPP
+/*
+  Variable projection chi^2
+
+  Many of the fitted models are linear in some of their parameters,
+  e.g., the projected beta model is n0^2 times a shape plus bkg.  For
+  each value of the other (nonlinear) parameters, varpro_chisq solves
+  those amplitudes by a nonnegative weighted linear least squares, and
+  returns the chi^2 at that solution, so that the optimizer only
+  searches the nonlinear parameters.  An amplitude is either
+    a scale, in which the model is homogeneous of some degree (n0: 2),
+      and which vanishes with all the scales at 0;
+    or an offset, which adds its absolute value to every bin (bkg).
+  The amplitudes must be frozen in the fitter while it fits; afterwards,
+  solve_amplitudes() sets them to their solution.  The model must be a
+  fused_model (e.g., projector or cached_model), which is evaluated at
+  the amplitudes of the basis functions without the param_modifier.
+*/
+
+#include <core/fitter.hpp>
+#include "fused_model.hpp"
+#include "residual_func.hpp"
+#include "progress_reporter.hpp"
+#include <vector>
+#include <string>
+#include <cmath>
+#include <limits>
+#include <iostream>
+
+namespace opt_utilities
+{
+  template <typename T>
+  class varpro_chisq
+    :public statistic<std::vector<T>,std::vector<T>,std::vector<T>,T,std::string>,
+     public residual_func<T>
+  {
+  private:
+    typedef std::vector<T> Tp;
+    std::vector<std::string> scale_names;
+    std::vector<T> scale_degrees;
+    std::string offset_name;
+    bool verb;
+    bool limit_bound;
+    progress_reporter progress;
+    //the basis functions of each data set, the fixed part of the model
+    //(if there is no scale), and the solution of the last evaluation
+    std::vector<std::vector<Tp> > basis;
+    std::vector<Tp> fixed;
+    std::vector<T> coef;
+
+    varpro_chisq<T>* do_clone()const
+    {
+      return new varpro_chisq<T>(*this);
+    }
+
+    const char* do_get_type_name()const
+    {
+      return "chi^2 statistic, variable projection";
+    }
+
+  public:
+    varpro_chisq()
+      :verb(false),limit_bound(false)
+    {}
+
+    //an amplitude in which the model is homogeneous of degree d
+    void add_scale_param(const std::string& name,T d)
+    {
+      scale_names.push_back(name);
+      scale_degrees.push_back(d);
+    }
+
+    //the amplitude added to every bin
+    void set_offset_param(const std::string& name)
+    {
+      offset_name=name;
+    }
+
+    //the names of the amplitudes, which the fitter must hold frozen
+    std::vector<std::string> get_amplitude_names()const
+    {
+      std::vector<std::string> names(scale_names);
+      if(!offset_name.empty())
+        {
+          names.push_back(offset_name);
+        }
+      return names;
+    }
+
+    size_t get_num_amplitudes()const
+    {
+      return scale_names.size()+(offset_name.empty()?0:1);
+    }
+
+    void verbose(bool v)
+    {
+      verb=v;
+    }
+
+    void set_limit()
+    {
+      limit_bound=true;
+    }
+
+    void clear_limit()
+    {
+      limit_bound=false;
+    }
+
+  private:
+    //y=m.eval() at the full parameters q, bypassing the param_modifier
+    static void eval_full(model<Tp,Tp,Tp>& m,const Tp& x,const Tp& q,Tp& y)
+    {
+      fused_model<Tp,Tp,Tp>* pf=dynamic_cast<fused_model<Tp,Tp,Tp>*>(&m);
+      if(!pf)
+        {
+          throw opt_exception("variable projection needs a fused_model");
+        }
+      pf->do_eval_into(x,q,y);
+    }
+
+    //solve a*c=b of order n in place, by Gaussian elimination with
+    //partial pivoting; false if a is singular
+    static bool solve_linear(std::vector<T>& a,std::vector<T>& b,size_t n)
+    {
+      for(size_t k=0;k<n;++k)
+        {
+          size_t piv=k;
+          for(size_t i=k+1;i<n;++i)
+            {
+              if(std::abs(a[i*n+k])>std::abs(a[piv*n+k]))
+                {
+                  piv=i;
+                }
+            }
+          if(!(std::abs(a[piv*n+k])>std::numeric_limits<T>::min()))
+            {
+              return false;
+            }
+          if(piv!=k)
+            {
+              for(size_t j=0;j<n;++j)
+                {
+                  std::swap(a[k*n+j],a[piv*n+j]);
+                }
+              std::swap(b[k],b[piv]);
+            }
+          for(size_t i=k+1;i<n;++i)
+            {
+              const T r=a[i*n+k]/a[k*n+k];
+              for(size_t j=k;j<n;++j)
+                {
+                  a[i*n+j]-=r*a[k*n+j];
+                }
+              b[i]-=r*b[k];
+            }
+        }
+      for(size_t k=n;k-->0;)
+        {
+          for(size_t j=k+1;j<n;++j)
+            {
+              b[k]-=a[k*n+j]*b[j];
+            }
+          b[k]/=a[k*n+k];
+        }
+      return true;
+    }
+
+    //the nonnegative c minimizing c'Ac-2c'b, by trying every set of
+    //active amplitudes, which is exact and cheap for a few of them
+    static void solve_nonnegative(const std::vector<T>& a,const std::vector<T>& b,
+                                  size_t n,std::vector<T>& c)
+    {
+      c.assign(n,0);
+      T best=0;
+      std::vector<size_t> idx;
+      std::vector<T> as,bs;
+      for(unsigned long mask=1;mask<(1UL<<n);++mask)
+        {
+          idx.clear();
+          for(size_t i=0;i<n;++i)
+            {
+              if(mask&(1UL<<i))
+                {
+                  idx.push_back(i);
+                }
+            }
+          const size_t m=idx.size();
+          as.resize(m*m);
+          bs.resize(m);
+          for(size_t i=0;i<m;++i)
+            {
+              bs[i]=b[idx[i]];
+              for(size_t j=0;j<m;++j)
+                {
+                  as[i*m+j]=a[idx[i]*n+idx[j]];
+                }
+            }
+          if(!solve_linear(as,bs,m))
+            {
+              continue;
+            }
+          bool feasible=true;
+          //the decrease of the chi^2 from c=0 is b_s'c_s at the solution
+          T gain=0;
+          for(size_t i=0;i<m;++i)
+            {
+              feasible=feasible&&bs[i]>=0;
+              gain+=b[idx[i]]*bs[i];
+            }
+          if(feasible&&gain>best)
+            {
+              best=gain;
+              c.assign(n,0);
+              for(size_t i=0;i<m;++i)
+                {
+                  c[idx[i]]=bs[i];
+                }
+            }
+        }
+    }
+
+    //evaluate the basis functions at the free parameters p, and solve
+    //the amplitudes into coef; false if p violates the limits
+    bool project(const Tp& p)
+    {
+      model<Tp,Tp,Tp>& m=this->p_fitter->get_model();
+      if(limit_bound&&!m.meets_constraint(p))
+        {
+          return false;
+        }
+      const data_set<Tp,Tp>& ds=this->get_data_set();
+      const size_t ns=scale_names.size();
+      const size_t n=get_num_amplitudes();
+      std::vector<size_t> order(ns);
+      for(size_t k=0;k<ns;++k)
+        {
+          order[k]=m.get_param_order(scale_names[k]);
+        }
+      Tp q(m.reform_param(p));
+      for(size_t k=0;k<ns;++k)
+        {
+          q[order[k]]=0;
+        }
+      if(!offset_name.empty())
+        {
+          q[m.get_param_order(offset_name)]=0;
+        }
+      basis.resize(ds.size());
+      fixed.resize(ds.size());
+      std::vector<T> a(n*n,0);
+      std::vector<T> b(n,0);
+      for(size_t i=0;i<ds.size();++i)
+        {
+          const data<Tp,Tp>& d=ds.get_data(i);
+          const Tp& y=d.get_y();
+          const Tp& ye=d.get_y_lower_err();
+          basis[i].resize(ns);
+          for(size_t k=0;k<ns;++k)
+            {
+              q[order[k]]=1;
+              eval_full(m,d.get_x(),q,basis[i][k]);
+              q[order[k]]=0;
+            }
+          if(ns==0)
+            {
+              eval_full(m,d.get_x(),q,fixed[i]);
+            }
+          else
+            {
+              fixed[i].assign(y.size(),0);
+            }
+          for(size_t j=0;j<y.size();++j)
+            {
+              const T w=1/(ye[j]*ye[j]);
+              const T r=y[j]-fixed[i][j];
+              for(size_t k=0;k<n;++k)
+                {
+                  const T bk=k<ns?basis[i][k][j]:T(1);
+                  b[k]+=w*bk*r;
+                  for(size_t l=0;l<=k;++l)
+                    {
+                      const T bl=l<ns?basis[i][l][j]:T(1);
+                      a[k*n+l]+=w*bk*bl;
+                    }
+                }
+            }
+        }
+      for(size_t k=0;k<n;++k)
+        {
+          for(size_t l=0;l<k;++l)
+            {
+              a[l*n+k]=a[k*n+l];
+            }
+        }
+      solve_nonnegative(a,b,n,coef);
+      return true;
+    }
+
+    //the model of the No. i data set at the last solution
+    T model_bin(size_t i,size_t j)const
+    {
+      const size_t ns=scale_names.size();
+      T ym=fixed[i][j];
+      for(size_t k=0;k<ns;++k)
+        {
+          ym+=coef[k]*basis[i][k][j];
+        }
+      if(!offset_name.empty())
+        {
+          ym+=coef[ns];
+        }
+      return ym;
+    }
+
+  public:
+    T do_eval(const Tp& p)
+    {
+      if(!project(p))
+        {
+          return 1e99;
+        }
+      const data_set<Tp,Tp>& ds=this->get_data_set();
+      T result(0);
+      for(size_t i=0;i<ds.size();++i)
+        {
+          const data<Tp,Tp>& d=ds.get_data(i);
+          const Tp& y=d.get_y();
+          const Tp& ye=d.get_y_lower_err();
+          for(size_t j=0;j<y.size();++j)
+            {
+              const T chi=(model_bin(i,j)-y[j])/ye[j];
+              result+=chi*chi;
+            }
+        }
+      if(verb&&progress.tick())
+        {
+          progress.report(std::cerr,result,p);
+        }
+      return result;
+    }
+
+    //residuals at the solved amplitudes; the Jacobian is left to the
+    //finite differences of the callers
+    bool eval_residuals(const Tp& p,std::vector<T>& r)
+    {
+      if(!project(p))
+        {
+          return false;
+        }
+      const data_set<Tp,Tp>& ds=this->get_data_set();
+      r.clear();
+      for(size_t i=0;i<ds.size();++i)
+        {
+          const data<Tp,Tp>& d=ds.get_data(i);
+          const Tp& y=d.get_y();
+          const Tp& ye=d.get_y_lower_err();
+          for(size_t j=0;j<y.size();++j)
+            {
+              r.push_back((model_bin(i,j)-y[j])/ye[j]);
+            }
+        }
+      return true;
+    }
+
+    //set the amplitudes of the fitter to their solution at its current
+    //parameters
+    void solve_amplitudes()
+    {
+      fitter<Tp,Tp,Tp,T,std::string>& f=*this->p_fitter;
+      if(!project(f.get_model().deform_param(f.get_all_params())))
+        {
+          throw opt_exception("the parameters violate the limits");
+        }
+      const size_t ns=scale_names.size();
+      for(size_t k=0;k<ns;++k)
+        {
+          f.set_param_value(scale_names[k],std::pow(coef[k],1/scale_degrees[k]));
+        }
+      if(!offset_name.empty())
+        {
+          f.set_param_value(offset_name,coef[ns]);
+        }
+    }
+  };
+}
+
+#endif
@@ -14,6 +14,12 @@
 #include <vector>
 #include <misc/optvec.hpp>
 #include <cmath>
+#include <algorithm>
+#include "parallel.hpp"
+#include "progress_reporter.hpp"
+#include "fused_model.hpp"
+#include "residual_func.hpp"
+#include "param_derivative.hpp"
 
 using std::cerr;
 using std::endl;
@@ -22,11 +28,22 @@ namespace opt_utilities
 {
   template<typename T>
   class vchisq
-    :public statistic<std::vector<T>,std::vector<T>,std::vector<T>,T,std::string>
+    :public statistic<std::vector<T>,std::vector<T>,std::vector<T>,T,std::string>,
+     public residual_func<T>
   {
   private:
     bool verb;
     bool limit_bound;
+    progress_reporter progress;
+    //block sums of the parallel reduction, and the model profile,
+    //kept between the calls
+    std::vector<T> partial;
+    std::vector<T> y_model;
+    std::vector<std::vector<T> > batch_y;
+    std::vector<std::vector<T> > deriv_y;
+    //1/sigma of each data set, and the errors it was computed from
+    std::vector<std::vector<T> > inv_err;
+    std::vector<std::vector<T> > err_key;
     typedef std::vector<T> Tp;
 
     vchisq<T>* do_clone()const
@@ -39,6 +56,58 @@ namespace opt_utilities
       return "chi^2 statistic";
     }
 
+    //1/sigma of the No. i data set, recomputed if the errors changed
+    const std::vector<T>& inverse_error(size_t i,const std::vector<T>& ye)
+    {
+      if(err_key[i]!=ye)
+	{
+	  err_key[i]=ye;
+	  inv_err[i].resize(ye.size());
+	  for(size_t j=0;j<ye.size();++j)
+	    {
+	      inv_err[i][j]=1/ye[j];
+	    }
+	}
+      return inv_err[i];
+    }
+
+    //sum_j ((ym[j]-yo[j])*w[j])^2, over fixed blocks added in order for
+    //long profiles, so that it does not depend on the number of threads
+    T residual_sum(const T* ym,const T* yo,const T* w,size_t n)
+    {
+      T result(0);
+      if(n<omp_min_bins())
+	{
+	  for(size_t j=0;j<n;++j)
+	    {
+	      T chi=(ym[j]-yo[j])*w[j];
+	      result+=chi*chi;
+	    }
+	  return result;
+	}
+      const int nblk=(n+omp_reduce_block-1)/omp_reduce_block;
+      partial.resize(nblk);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+      for(int b=0;b<nblk;++b)
+	{
+	  const size_t jend=std::min(n,(b+1)*omp_reduce_block);
+	  T sum=0;
+	  for(size_t j=b*omp_reduce_block;j<jend;++j)
+	    {
+	      T chi=(ym[j]-yo[j])*w[j];
+	      sum+=chi*chi;
+	    }
+	  partial[b]=sum;
+	}
+      for(int b=0;b<nblk;++b)
+	{
+	  result+=partial[b];
+	}
+      return result;
+    }
+
   public:
     void verbose(bool v)
     {
@@ -69,67 +138,134 @@ namespace opt_utilities
 	    }
 	}
       T result(0);
-      std::vector<float> vx;
-      std::vector<float> vy;
-      std::vector<float> vye;
-      std::vector<float> my;
-      float x1=1e99,x2=-1e99,y1=1e99,y2=-1e99;
-      int n=0;
-      if(verb)
-	{
-	  n++;
-	  if(n%100==0)
-	    {
-	      vx.resize(this->get_data_set().get_data(0).get_y().size());
-	      vy.resize(this->get_data_set().get_data(0).get_y().size());
-	      vye.resize(this->get_data_set().get_data(0).get_y().size());
-	      my.resize(this->get_data_set().get_data(0).get_y().size());
-	    }
+      const data_set<std::vector<T>,std::vector<T> >& ds=this->get_data_set();
+      model<std::vector<T>,std::vector<T>,std::vector<T> >& m=this->p_fitter->get_model();
+      if(inv_err.size()!=ds.size())
+	{
+	  inv_err.resize(ds.size());
+	  err_key.resize(ds.size());
+	}
+      //the model is evaluated into y_model, and the residuals are
+      //summed in one pass over contiguous arrays
+      for(int i=ds.size()-1;i>=0;--i)
+	{
+	  const data<std::vector<T>,std::vector<T> >& d=ds.get_data(i);
+	  eval_model_into(m,d.get_x(),p,y_model);
+	  const std::vector<T>& y=d.get_y();
+	  const std::vector<T>& ie=inverse_error(i,d.get_y_lower_err());
+	  result+=residual_sum(&y_model[0],&y[0],&ie[0],y.size());
+	}
+      if(verb&&progress.tick())
+	{
+	  progress.report(cerr,result,p);
+	}
+
+      return result;
+    }
+
+    //residuals of all the bins, (y_model-y_obs)/sigma, data set by data set
+    bool eval_residuals(const std::vector<T>& p,std::vector<T>& r)
+    {
+      if(limit_bound&&!this->get_fitter().get_model().meets_constraint(p))
+	{
+	  return false;
+	}
+      const data_set<std::vector<T>,std::vector<T> >& ds=this->get_data_set();
+      model<std::vector<T>,std::vector<T>,std::vector<T> >& m=this->p_fitter->get_model();
+      if(inv_err.size()!=ds.size())
+	{
+	  inv_err.resize(ds.size());
+	  err_key.resize(ds.size());
 	}
-      for(int i=(this->get_data_set()).size()-1;i>=0;--i)
+      r.clear();
+      for(size_t i=0;i<ds.size();++i)
 	{
-	  const std::vector<double> y_model(this->eval_model(this->get_data_set().get_data(i).get_x(),p));
-	  const std::vector<double>& y=this->get_data_set().get_data(i).get_y();
-	  const std::vector<double>& ye=this->get_data_set().get_data(i).get_y_lower_err();
+	  const data<std::vector<T>,std::vector<T> >& d=ds.get_data(i);
+	  eval_model_into(m,d.get_x(),p,y_model);
+	  const std::vector<T>& y=d.get_y();
+	  const std::vector<T>& ie=inverse_error(i,d.get_y_lower_err());
 	  for(size_t j=0;j<y.size();++j)
 	    {
-	      double chi=(y_model[j]-y[j])/ye[j];
-	      result+=chi*chi;
+	      r.push_back((y_model[j]-y[j])*ie[j]);
 	    }
+	}
+      return true;
+    }
 
-	  if(verb&&n%100==0)
+    //Jacobian of the residuals, from the derivatives of the model
+    bool eval_jacobian(const std::vector<T>& p,std::vector<T>& jac)
+    {
+      const data_set<std::vector<T>,std::vector<T> >& ds=this->get_data_set();
+      model<std::vector<T>,std::vector<T>,std::vector<T> >& m=this->p_fitter->get_model();
+      if(inv_err.size()!=ds.size())
+	{
+	  inv_err.resize(ds.size());
+	  err_key.resize(ds.size());
+	}
+      const param_modifier<std::vector<T>,std::vector<T>,std::vector<T>,std::string>* pm=find_param_modifier(m);
+      const size_t np=p.size();
+      jac.clear();
+      for(size_t i=0;i<ds.size();++i)
+	{
+	  const data<std::vector<T>,std::vector<T> >& d=ds.get_data(i);
+	  if(!eval_model_derivative(m,pm,d.get_x(),p,deriv_y))
+	    {
+	      return false;
+	    }
+	  const std::vector<T>& ie=inverse_error(i,d.get_y_lower_err());
+	  const size_t row0=jac.size()/np;
+	  jac.resize(jac.size()+ie.size()*np);
+	  for(size_t j=0;j<ie.size();++j)
 	    {
-	      for(size_t j=0;j<y.size();++j)
+	      for(size_t k=0;k<np;++k)
 		{
-		  vx.at(j)=((this->get_data_set().get_data(i).get_x().at(j)+this->get_data_set().get_data(i).get_x().at(j+1))/2.);
-		  vy.at(j)=(y[j]);
-		  vye.at(j)=ye[j];
-		  my.at(j)=(y_model[j]);
-		  x1=std::min(vx.at(j),x1);
-		  y1=std::min(vy.at(j),y1);
-		  x2=std::max(vx.at(j),x2);
-		  y2=std::max(vy.at(j),y2);
-		  vye[j]=log10(vy[j]+vye[j])-log10(vy[j]);
-		  vx[j]=log10(vx[j]);
-		  vy[j]=log10(vy[j]);
-		  my[j]=log10(my[j]);
+		  jac[(row0+j)*np+k]=deriv_y[k][j]*ie[j];
 		}
 	    }
 	}
-      if(verb)
+      return true;
+    }
+
+    //chi^2 of each of the parameter vectors ps, with the model evaluated
+    //for all of them in one batch, e.g., for the grid scans and the
+    //multiple starts; same as do_eval() up to the rounding
+    void eval_batch(const std::vector<Tp>& ps,std::vector<T>& result)
+    {
+      result.assign(ps.size(),0);
+      std::vector<Tp> valid_p;
+      std::vector<size_t> valid_index;
+      for(size_t k=0;k<ps.size();++k)
 	{
-	  if(n%100==0)
+	  if(limit_bound&&!this->get_fitter().get_model().meets_constraint(ps[k]))
 	    {
-	      cerr<<result<<"\t";
-	      for(size_t i=0;i<get_size(p);++i)
-		{
-		  cerr<<get_element(p,i)<<",";
-		}
-	      cerr<<endl;
+	      result[k]=1e99;
+	      continue;
+	    }
+	  valid_p.push_back(ps[k]);
+	  valid_index.push_back(k);
+	}
+      if(valid_p.empty())
+	{
+	  return;
+	}
+      const data_set<std::vector<T>,std::vector<T> >& ds=this->get_data_set();
+      model<std::vector<T>,std::vector<T>,std::vector<T> >& m=this->p_fitter->get_model();
+      if(inv_err.size()!=ds.size())
+	{
+	  inv_err.resize(ds.size());
+	  err_key.resize(ds.size());
+	}
+      for(int i=ds.size()-1;i>=0;--i)
+	{
+	  const data<std::vector<T>,std::vector<T> >& d=ds.get_data(i);
+	  eval_model_batch(m,d.get_x(),valid_p,batch_y);
+	  const std::vector<T>& y=d.get_y();
+	  const std::vector<T>& ie=inverse_error(i,d.get_y_lower_err());
+	  for(size_t k=0;k<valid_p.size();++k)
+	    {
+	      result[valid_index[k]]+=residual_sum(&batch_y[k][0],&y[0],&ie[0],y.size());
 	    }
 	}
-
-      return result;
     }
   };
 
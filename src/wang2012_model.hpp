@@ -9,13 +9,16 @@
 #define WANG2012_MODEL
 #define OPT_HEADER
 #include <core/fitter.hpp>
+#include "param_derivative.hpp"
+#include "dual.hpp"
 #include <cmath>
 
 namespace opt_utilities
 {
   template <typename T>
   class wang2012_model
-    :public model<T,T,std::vector<T>,std::string>
+    :public model<T,T,std::vector<T>,std::string>,
+     public param_derivative<T,T,std::vector<T> >
   {
   private:
     model<T,T,std::vector<T> >* do_clone()const
@@ -42,6 +45,7 @@ namespace opt_utilities
 
     T do_eval(const T& x,const std::vector<T>& param)
     {
+      using std::pow;
       T A=param[0];
       T n=param[1];
       T xi=param[2];
@@ -53,6 +57,34 @@ namespace opt_utilities
       //return A*(pow(x,n)+a1)/(pow(x,n)+1)/pow(1+x*x/a3/a3,beta)+T0;
     }
 
+    bool do_eval_derivative(const T& x,const std::vector<T>& param,std::vector<T>& dy)
+    {
+      using std::pow;
+      using std::log;
+      T A=param[0];
+      T n=param[1];
+      T xi=param[2];
+      T a2=param[3];
+      T a3=param[4];
+      T beta=param[5];
+      T xn=pow(x,n);
+      T num=xn+xi*a2;
+      T den=xn+a2;
+      T q=1+x*x/a3/a3;
+      T s=pow(q,-beta);
+      //d(xn)/dn, zero at x=0
+      T dxn=x>0?xn*log(x):0;
+      dy.resize(7);
+      dy[0]=num/den*s;
+      dy[1]=A*s*dxn*a2*(1-xi)/(den*den);
+      dy[2]=A*s*a2/den;
+      dy[3]=A*s*xn*(xi-1)/(den*den);
+      dy[4]=A*num/den*s*2*beta*x*x/(a3*a3*a3*q);
+      dy[5]=-A*num/den*s*log(q);
+      dy[6]=1;
+      return true;
+    }
+
   private:
     std::string do_get_information()const
     {